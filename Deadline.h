@@ -0,0 +1,94 @@
+// Time budgets of the phases of a wake and of the whole wake, backed by the task watchdog
+
+#ifndef DEADLINE_H_
+#define DEADLINE_H_
+
+#include <Arduino.h>
+#include <esp_idf_version.h>
+#include <esp_system.h>
+#include <esp_task_wdt.h>
+
+// Each phase ends at its own budget or at the total budget, whichever comes first.
+// The budget of the panel is reserved at the end of the total, so that a slow network still leaves time to refresh the panel.
+// Times are measured from the wake-up, when millis() starts from 0. A long download may extend the budgets by extend().
+class Deadline {
+public:
+  enum Phase {
+    CONNECT,  // Association and NTP.
+    TRANSFER,  // HTTP and TLS including the backoff.
+    PANEL,  // Busy waits of the EPD.
+    PHASES
+  };
+  static constexpr const uint32_t TOTAL_BUDGET = 150000;  // Awake time (ms).
+  static constexpr const uint32_t WATCHDOG_MARGIN = 30000;  // Time after the total budget until the watchdog resets the chip (ms).
+
+  Deadline() : total_(TOTAL_BUDGET), end_(0) {
+  }
+
+  ~Deadline() {
+  }
+
+  // Arms the task watchdog, which resets the chip even if a call hangs past the total budget.
+  void begin() {
+    arm();
+    esp_task_wdt_add(nullptr);
+  }
+
+  void start(Phase phase) {
+    const uint32_t now = millis();
+    const uint32_t limit = total_ - ((phase == PANEL) ? 0 : budget(PANEL));
+    end_ = now + budget(phase);
+    if (end_ > limit) end_ = (now < limit) ? limit : now;
+  }
+
+  // Extends the current phase and the total budget by time (ms), and the watchdog with them.
+  void extend(uint32_t time) {
+    total_ += time;
+    end_ += time;
+    arm();
+    esp_task_wdt_reset();
+  }
+
+  // Returns the time left in the current phase (ms).
+  uint32_t remaining() const {
+    const uint32_t now = millis();
+    return (now < end_) ? end_ - now : 0;
+  }
+
+  bool expired() const {
+    return (remaining() == 0);
+  }
+
+  // Returns true if the previous wake was cut off by a watchdog.
+  static bool overran() {
+    const esp_reset_reason_t reason = esp_reset_reason();
+    return (reason == ESP_RST_TASK_WDT || reason == ESP_RST_INT_WDT || reason == ESP_RST_WDT);
+  }
+
+private:
+  // Sets the watchdog to the end of the total budget with the margin.
+  void arm() {
+    const uint32_t now = millis();
+    const uint32_t timeout = ((total_ > now) ? total_ - now : 0) + WATCHDOG_MARGIN;
+#if ESP_IDF_VERSION_MAJOR >= 5
+    const esp_task_wdt_config_t config = {timeout, 0, true};
+    if (esp_task_wdt_reconfigure(&config) != ESP_OK) esp_task_wdt_init(&config);
+#else
+    esp_task_wdt_init((timeout + 999) / 1000, true);  // Updates the timeout if it was already initialized.
+#endif
+  }
+
+  static uint32_t budget(Phase phase) {
+    static const uint32_t budgets[PHASES] = {
+      30000,  // CONNECT
+      90000,  // TRANSFER
+      30000,  // PANEL
+    };
+    return budgets[phase];
+  }
+
+  uint32_t total_;
+  uint32_t end_;
+};
+
+#endif
@@ -1,4 +1,4 @@
-// Library for Waveshare 2.7-inch e-Paper (B)
+// Library for Waveshare e-Paper (B) panels
 
 #ifndef EPDCLASS_H_
 #define EPDCLASS_H_
@@ -6,77 +6,184 @@
 #include <Arduino.h>
 #include <SPI.h>
 
-class EPDClass {
-public:
+// Panel traits give the geometry, the polarity of the planes relative to 1 = ink, and the controller specific commands.
+// The frame data is sent by the commands common to the controllers: 0x10 (black), 0x13 (red) and 0x12 (refresh).
+
+// 2.7-inch e-Paper (B), 176x264.
+struct EPD2in7B {
   static constexpr const int WIDTH = 176;
   static constexpr const int HEIGHT = 264;
+  static constexpr const bool INVERT_BLACK = false;
+  static constexpr const bool INVERT_RED = false;
 
-  EPDClass(int busy_pin, int rst_pin, int dc_pin, int csb_pin) : busy_pin_(busy_pin), rst_pin_(rst_pin), dc_pin_(dc_pin), csb_pin_(csb_pin) {
-  }
-
-  ~EPDClass() {
-  }
-
-  void begin() {
-    pinMode(busy_pin_, INPUT); 
-    pinMode(rst_pin_, OUTPUT);
-    pinMode(dc_pin_, OUTPUT);
-    pinMode(csb_pin_, OUTPUT);
-    SPI.begin();
-    SPI.beginTransaction(SPISettings(2000000, MSBFIRST, SPI_MODE0));
-
-    // Reset
-    digitalWrite(rst_pin_, LOW);
-    delay(200);
-    digitalWrite(rst_pin_, HIGH);
-    delay(200);   
-
+  template <class EPD> static void init(EPD &epd) {
     // Power on
-    command(0x04, 0, nullptr);
-    while (digitalRead(busy_pin_) == LOW) delay(100);
+    epd.command(0x04, 0, nullptr);
+    epd.wait();
 
     // Panel setting.
-    command(0x00, 1, (const uint8_t []){0xaf});
+    epd.command(0x00, 1, (const uint8_t []){0xaf});
 
     // PLL control
-    command(0x30, 1, (const uint8_t []){0x3a});
+    epd.command(0x30, 1, (const uint8_t []){0x3a});
 
     // Power setting.
-    command(0x01, 5, (const uint8_t []){0x02, 0x00, 0x2b, 0x2b, 0x09});  // Disable internal DC-DC for VDH/VDL.
+    epd.command(0x01, 5, (const uint8_t []){0x02, 0x00, 0x2b, 0x2b, 0x09});  // Disable internal DC-DC for VDH/VDL.
 
     // Booster soft start
-    command(0x06, 3, (const uint8_t []){0x07, 0x07, 0x17});
+    epd.command(0x06, 3, (const uint8_t []){0x07, 0x07, 0x17});
 
     // Power optimization
-    command(0xf8, 2, (const uint8_t []){0x60, 0xa5});
-    command(0xf8, 2, (const uint8_t []){0x89, 0xa5});
-    command(0xf8, 2, (const uint8_t []){0x90, 0x00});
-    command(0xf8, 2, (const uint8_t []){0x93, 0x2a});
-    command(0xf8, 2, (const uint8_t []){0x73, 0x41});
+    epd.command(0xf8, 2, (const uint8_t []){0x60, 0xa5});
+    epd.command(0xf8, 2, (const uint8_t []){0x89, 0xa5});
+    epd.command(0xf8, 2, (const uint8_t []){0x90, 0x00});
+    epd.command(0xf8, 2, (const uint8_t []){0x93, 0x2a});
+    epd.command(0xf8, 2, (const uint8_t []){0x73, 0x41});
 
     // VCM_DC setting register
-    command(0x82, 1, (const uint8_t []){0x12});
+    epd.command(0x82, 1, (const uint8_t []){0x12});
 
     // VCOM and data interval setting
-    command(0x50, 1, (const uint8_t []){0x87});
+    epd.command(0x50, 1, (const uint8_t []){0x87});
 
     // LUT for VCOM
-    command(0x20, 44, (const uint8_t []){0x00, 0x00, 0x00, 0x1a, 0x1a, 0x00, 0x00, 0x01, 0x00, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x00, 0x0e, 0x01, 0x0e, 0x01, 0x10, 0x00, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x00, 0x04, 0x10, 0x00, 0x00, 0x05, 0x00, 0x03, 0x0e, 0x00, 0x00, 0x0a, 0x00, 0x23, 0x00, 0x00, 0x00, 0x01});
+    epd.command(0x20, 44, (const uint8_t []){0x00, 0x00, 0x00, 0x1a, 0x1a, 0x00, 0x00, 0x01, 0x00, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x00, 0x0e, 0x01, 0x0e, 0x01, 0x10, 0x00, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x00, 0x04, 0x10, 0x00, 0x00, 0x05, 0x00, 0x03, 0x0e, 0x00, 0x00, 0x0a, 0x00, 0x23, 0x00, 0x00, 0x00, 0x01});
 
     // White to white LUT
-    command(0x21, 42, (const uint8_t []){0x90, 0x1a, 0x1a, 0x00, 0x00, 0x01, 0x40, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x84, 0x0e, 0x01, 0x0e, 0x01, 0x10, 0x80, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x00, 0x04, 0x10, 0x00, 0x00, 0x05, 0x00, 0x03, 0x0e, 0x00, 0x00, 0x0a, 0x00, 0x23, 0x00, 0x00, 0x00, 0x01});
+    epd.command(0x21, 42, (const uint8_t []){0x90, 0x1a, 0x1a, 0x00, 0x00, 0x01, 0x40, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x84, 0x0e, 0x01, 0x0e, 0x01, 0x10, 0x80, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x00, 0x04, 0x10, 0x00, 0x00, 0x05, 0x00, 0x03, 0x0e, 0x00, 0x00, 0x0a, 0x00, 0x23, 0x00, 0x00, 0x00, 0x01});
 
     // Black to white LUT
-    command(0x22, 42, (const uint8_t []){0xa0, 0x1a, 0x1a, 0x00, 0x00, 0x01, 0x00, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x84, 0x0e, 0x01, 0x0e, 0x01, 0x10, 0x90, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0xb0, 0x04, 0x10, 0x00, 0x00, 0x05, 0xb0, 0x03, 0x0e, 0x00, 0x00, 0x0a, 0xc0, 0x23, 0x00, 0x00, 0x00, 0x01});
+    epd.command(0x22, 42, (const uint8_t []){0xa0, 0x1a, 0x1a, 0x00, 0x00, 0x01, 0x00, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x84, 0x0e, 0x01, 0x0e, 0x01, 0x10, 0x90, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0xb0, 0x04, 0x10, 0x00, 0x00, 0x05, 0xb0, 0x03, 0x0e, 0x00, 0x00, 0x0a, 0xc0, 0x23, 0x00, 0x00, 0x00, 0x01});
 
     // White to Black LUT
-    command(0x23, 42, (const uint8_t []){0x90, 0x1a, 0x1a, 0x00, 0x00, 0x01, 0x40, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x84, 0x0e, 0x01, 0x0e, 0x01, 0x10, 0x80, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x00, 0x04, 0x10, 0x00, 0x00, 0x05, 0x00, 0x03, 0x0e, 0x00, 0x00, 0x0a, 0x00, 0x23, 0x00, 0x00, 0x00, 0x01});
+    epd.command(0x23, 42, (const uint8_t []){0x90, 0x1a, 0x1a, 0x00, 0x00, 0x01, 0x40, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x84, 0x0e, 0x01, 0x0e, 0x01, 0x10, 0x80, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x00, 0x04, 0x10, 0x00, 0x00, 0x05, 0x00, 0x03, 0x0e, 0x00, 0x00, 0x0a, 0x00, 0x23, 0x00, 0x00, 0x00, 0x01});
 
     // Black to Black LUT
-    command(0x24, 42, (const uint8_t []){0x90, 0x1a, 0x1a, 0x00, 0x00, 0x01, 0x20, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x84, 0x0e, 0x01, 0x0e, 0x01, 0x10, 0x10, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x00, 0x04, 0x10, 0x00, 0x00, 0x05, 0x00, 0x03, 0x0e, 0x00, 0x00, 0x0a, 0x00, 0x23, 0x00, 0x00, 0x00, 0x01});
+    epd.command(0x24, 42, (const uint8_t []){0x90, 0x1a, 0x1a, 0x00, 0x00, 0x01, 0x20, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x84, 0x0e, 0x01, 0x0e, 0x01, 0x10, 0x10, 0x0a, 0x0a, 0x00, 0x00, 0x08, 0x00, 0x04, 0x10, 0x00, 0x00, 0x05, 0x00, 0x03, 0x0e, 0x00, 0x00, 0x0a, 0x00, 0x23, 0x00, 0x00, 0x00, 0x01});
 
     // Partial display refresh
-    command(0x16, 1, (const uint8_t []){0x00});
+    epd.command(0x16, 1, (const uint8_t []){0x00});
+  }
+
+  template <class EPD> static void frame(EPD &epd) {
+    // TCON resolution
+    epd.command(0x61, 4, (const uint8_t []){WIDTH >> 8, WIDTH & 0xff, HEIGHT >> 8, HEIGHT & 0xff});
+  }
+
+  template <class EPD> static void sleep(EPD &epd) {
+    // Deep sleep
+    epd.command(0x07, 1, (const uint8_t []){0xa5});
+  }
+};
+
+// 4.2-inch e-Paper (B) with IL0398, 400x300. Untested.
+struct EPD4in2B {
+  static constexpr const int WIDTH = 400;
+  static constexpr const int HEIGHT = 300;
+  static constexpr const bool INVERT_BLACK = true;
+  static constexpr const bool INVERT_RED = true;
+
+  template <class EPD> static void init(EPD &epd) {
+    // Booster soft start
+    epd.command(0x06, 3, (const uint8_t []){0x17, 0x17, 0x17});
+
+    // Power on
+    epd.command(0x04, 0, nullptr);
+    epd.wait();
+
+    // Panel setting
+    epd.command(0x00, 1, (const uint8_t []){0x0f});
+  }
+
+  template <class EPD> static void frame(EPD &epd) {
+  }
+
+  template <class EPD> static void sleep(EPD &epd) {
+    // VCOM and data interval setting
+    epd.command(0x50, 1, (const uint8_t []){0xf7});
+
+    // Power off
+    epd.command(0x02, 0, nullptr);
+    epd.wait();
+
+    // Deep sleep
+    epd.command(0x07, 1, (const uint8_t []){0xa5});
+  }
+};
+
+// 7.5-inch e-Paper (B) V2 with GD7965, 800x480. Untested.
+struct EPD7in5BV2 {
+  static constexpr const int WIDTH = 800;
+  static constexpr const int HEIGHT = 480;
+  static constexpr const bool INVERT_BLACK = true;
+  static constexpr const bool INVERT_RED = false;
+
+  template <class EPD> static void init(EPD &epd) {
+    // Power setting
+    epd.command(0x01, 4, (const uint8_t []){0x07, 0x07, 0x3f, 0x3f});
+
+    // Power on
+    epd.command(0x04, 0, nullptr);
+    delay(100);
+    epd.wait();
+
+    // Panel setting
+    epd.command(0x00, 1, (const uint8_t []){0x0f});
+
+    // Resolution setting
+    epd.command(0x61, 4, (const uint8_t []){WIDTH >> 8, WIDTH & 0xff, HEIGHT >> 8, HEIGHT & 0xff});
+
+    // Dual SPI off
+    epd.command(0x15, 1, (const uint8_t []){0x00});
+
+    // VCOM and data interval setting
+    epd.command(0x50, 2, (const uint8_t []){0x11, 0x07});
+
+    // TCON setting
+    epd.command(0x60, 1, (const uint8_t []){0x22});
+  }
+
+  template <class EPD> static void frame(EPD &epd) {
+  }
+
+  template <class EPD> static void sleep(EPD &epd) {
+    // Power off
+    epd.command(0x02, 0, nullptr);
+    epd.wait();
+
+    // Deep sleep
+    epd.command(0x07, 1, (const uint8_t []){0xa5});
+  }
+};
+
+template <class Panel> class EPDClass {
+public:
+  static constexpr const int WIDTH = Panel::WIDTH;
+  static constexpr const int HEIGHT = Panel::HEIGHT;
+  static constexpr const int LINE_SIZE = WIDTH / 8;  // Bytes per row.
+  static_assert(WIDTH % 8 == 0, "Width must be a multiple of 8.");
+
+  EPDClass(int busy_pin, int rst_pin, int dc_pin, int csb_pin) : busy_pin_(busy_pin), rst_pin_(rst_pin), dc_pin_(dc_pin), csb_pin_(csb_pin), timeout_(UINT32_MAX), since_(0), timed_out_(false) {
+  }
+
+  ~EPDClass() {
+  }
+
+  void begin() {
+    pinMode(busy_pin_, INPUT); 
+    pinMode(rst_pin_, OUTPUT);
+    pinMode(dc_pin_, OUTPUT);
+    pinMode(csb_pin_, OUTPUT);
+    SPI.begin();
+    SPI.beginTransaction(SPISettings(2000000, MSBFIRST, SPI_MODE0));
+
+    // Reset
+    digitalWrite(rst_pin_, LOW);
+    delay(200);
+    digitalWrite(rst_pin_, HIGH);
+    delay(200);   
+
+    Panel::init(*this);
   }
 
   void end() {
@@ -84,33 +191,80 @@ public:
     SPI.end();
   }
 
+  // Writes and refreshes a whole frame.
   void write(const uint8_t *buf_black, const uint8_t *buf_red) {
-    // TCON resolution
-    command(0x61, 4, (const uint8_t []){WIDTH >> 8, WIDTH & 0xff, HEIGHT >> 8, HEIGHT & 0xff});
-
-    // Data start transmission 1
-    command(0x10, WIDTH * HEIGHT / 8, buf_black);
+    beginPlane(0);
+    writeBand(0, buf_black, LINE_SIZE * HEIGHT);
     delay(2);
-
-    // Data start transmission 2
-    command(0x13, WIDTH * HEIGHT / 8, buf_red);
+    beginPlane(1);
+    writeBand(1, buf_red, LINE_SIZE * HEIGHT);
     delay(2);
+    refresh();
+  }
 
+  // Starts the transmission of a plane (0: black, 1: red), which is followed by writeBand() for all the rows from the top.
+  void beginPlane(int plane) {
+    if (plane == 0) Panel::frame(*this);
+    command((plane == 0) ? 0x10 : 0x13, 0, nullptr);
+  }
+
+  // Sends rows of the plane in 1 = ink.
+  void writeBand(int plane, const uint8_t *buf, int size) {
+    const uint8_t mask = (plane == 0) ? (Panel::INVERT_BLACK ? 0xff : 0x00) : (Panel::INVERT_RED ? 0xff : 0x00);
+    digitalWrite(dc_pin_, HIGH);
+    for (int i = 0; i < size; i++) {
+      digitalWrite(csb_pin_, LOW);
+      SPI.transfer(buf[i] ^ mask);
+      digitalWrite(csb_pin_, HIGH);
+    }
+  }
+
+  void refresh() {
     // Display refresh
     command(0x12, 0, nullptr);
-    while (digitalRead(busy_pin_) == LOW) delay(100);
+    wait();
+  }
+
+  // Renders the frame in bands of the given height into buf, which has LINE_SIZE * band bytes.
+  // render(plane, row, rows, buf) fills the rows starting from row of the plane.
+  template <class Render> void draw(uint8_t *buf, int band, Render render) {
+    for (int plane = 0; plane < 2; plane++) {
+      beginPlane(plane);
+      for (int row = 0; row < HEIGHT; row += band) {
+        const int rows = min(band, HEIGHT - row);
+        render(plane, row, rows, buf);
+        writeBand(plane, buf, LINE_SIZE * rows);
+      }
+      delay(2);
+    }
+    refresh();
   }
 
   void sleep(void) {
-    // Deep sleep
-    command(0x07, 1, (const uint8_t []){0xa5});
+    Panel::sleep(*this);
+  }
+
+  // Limits the total time of the busy waits from now (ms). The commands after the limit are sent without waiting.
+  void setTimeout(uint32_t timeout) {
+    timeout_ = timeout;
+    since_ = millis();
+    timed_out_ = false;
+  }
+
+  bool timedOut() const {
+    return timed_out_;
   }
 
 private:
+  friend Panel;
+
   int busy_pin_;
   int rst_pin_;
   int dc_pin_;
   int csb_pin_;
+  uint32_t timeout_;
+  uint32_t since_;
+  bool timed_out_;
 
   void command(uint8_t cmd, int size, const uint8_t *data) {
     digitalWrite(dc_pin_, LOW);
@@ -125,6 +279,16 @@ private:
       digitalWrite(csb_pin_, HIGH);
     }
   }
+
+  void wait() {
+    while (digitalRead(busy_pin_) == LOW) {
+      if (millis() - since_ >= timeout_) {
+        timed_out_ = true;
+        break;
+      }
+      delay(100);
+    }
+  }
 };
 
 #endif
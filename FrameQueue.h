@@ -0,0 +1,181 @@
+// Queue of frames to be displayed at given times, stored in the "frames" flash partition
+
+#ifndef FRAMEQUEUE_H_
+#define FRAMEQUEUE_H_
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_partition.h>
+#else
+#include "pc_version/Partition.h"
+#endif
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+// The first sector holds the index, and each slot after it holds the black and red planes of a frame.
+// Each plane starts at a sector boundary, so that a plane can be written again after erasing only its own sectors.
+// The slots form a ring. A new queue is written into the slots after the stored one, which stays valid until commit().
+// RETAINED is not a part of the queue but keeps a copy of the frame on the panel. It rotates through the last COPIES slots
+// to spread the erases of a frequently changing frame. A new copy is written into the next slot, and retain() switches to it.
+class FrameQueue {
+public:
+  static constexpr const int CAPACITY = 128;
+  static constexpr const int RETAINED = CAPACITY;
+  static constexpr const int COPIES = 4;
+  static constexpr const uint32_t SECTOR_SIZE = 4096;
+
+  FrameQueue(uint32_t plane_size) : partition_(nullptr), plane_size_(plane_size), plane_area_((plane_size + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE), capacity_(0) {
+    index_.magic = 0;
+    index_.first = 0;
+    index_.count = 0;
+    index_.retained = ~0u;
+  }
+
+  ~FrameQueue() {
+  }
+
+  // Finds the partition and loads the index. Returns false if there is no partition.
+  bool begin() {
+    partition_ = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "frames");
+    if (!partition_) return false;
+    capacity_ = std::min((int)((partition_->size - SECTOR_SIZE) / (2 * plane_area_)) - COPIES, CAPACITY);
+    if (capacity_ < 0) {
+      partition_ = nullptr;
+      return false;
+    }
+    if (esp_partition_read(partition_, 0, &index_, sizeof(index_)) != ESP_OK || index_.magic != MAGIC || index_.plane_size != plane_size_ || index_.first >= (uint32_t)capacity_ || index_.count > (uint32_t)capacity_) {
+      index_.magic = 0;  // Not stored yet.
+      index_.first = 0;
+      index_.count = 0;
+      index_.retained = ~0u;
+    }
+    return true;
+  }
+
+  int capacity() const {
+    return capacity_;
+  }
+
+  int size() const {
+    return index_.count;
+  }
+
+  uint32_t expires() const {
+    return index_.expires;
+  }
+
+  // Returns the display time of the slot (UNIX time).
+  uint32_t time(int slot) const {
+    return index_.times[slot];
+  }
+
+  // Writes a part of a plane of the slot of the new queue, or of the next copy of RETAINED. The sectors whose start is in the range are erased first.
+  // When the new queue has wrapped around to the stored one, the oldest frames of the stored one are dropped first.
+  bool write(int slot, int plane, uint32_t ofst, const uint8_t *data, uint32_t size) {
+    if (slot != RETAINED && slot >= 0 && slot < capacity_) {
+      const int overlap = (int)index_.count + slot + 1 - capacity_;
+      if (overlap > 0 && !drop(overlap)) return false;
+    }
+    const uint32_t base = (slot == RETAINED) ? offset(capacity_ + (copy() + 1) % COPIES, plane) : address(slot, plane, index_.count);
+    if (!base || ofst + size > plane_size_) return false;
+    for (uint32_t sector = (ofst + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE; sector < ofst + size; sector += SECTOR_SIZE) {
+      if (esp_partition_erase_range(partition_, base + sector, SECTOR_SIZE) != ESP_OK) return false;
+    }
+    return (esp_partition_write(partition_, base + ofst, data, size) == ESP_OK);
+  }
+
+  bool read(int slot, int plane, uint32_t ofst, uint8_t *data, uint32_t size) const {
+    const uint32_t base = (slot == RETAINED) ? offset(capacity_ + copy(), plane) : address(slot, plane, 0);
+    if (!base || (slot != RETAINED && slot >= (int)index_.count) || ofst + size > plane_size_) return false;
+    return (esp_partition_read(partition_, base + ofst, data, size) == ESP_OK);
+  }
+
+  // Replaces the stored queue by the slots of the new queue written so far. times must be in ascending order.
+  bool commit(const uint32_t *times, int count, uint32_t expires) {
+    if (!partition_ || count > capacity_) return false;
+    index_.first = (index_.first + index_.count) % capacity_;
+    index_.count = count;
+    index_.expires = expires;
+    memcpy(index_.times, times, sizeof(uint32_t) * count);
+    return store();
+  }
+
+  // Switches RETAINED to the copy written since the last switch. The index is rewritten only once in 32 switches,
+  // since the switch clears a bit of the stored index, which needs no erase.
+  bool retain() {
+    if (!partition_) return false;
+    if (index_.magic != MAGIC || index_.retained == 0) {
+      index_.retained = ~0u << ((copy() + 1) % COPIES);  // The same number of cleared bits gives the next copy.
+      return store();
+    }
+    index_.retained &= index_.retained - 1;
+    return (esp_partition_write(partition_, offsetof(Index, retained), &index_.retained, sizeof(index_.retained)) == ESP_OK);
+  }
+
+  // Returns the slot to be displayed at now (UNIX time), or -1 if it is earlier than the first frame.
+  int due(uint32_t now) const {
+    int slot = -1;
+    for (int i = 0; i < (int)index_.count && index_.times[i] <= now; i++) slot = i;
+    return slot;
+  }
+
+  // Returns the time of the first frame after now, or 0 if the queue runs dry.
+  uint32_t next(uint32_t now) const {
+    for (int i = 0; i < (int)index_.count; i++) {
+      if (index_.times[i] > now) return index_.times[i];
+    }
+    return 0;
+  }
+
+private:
+  static constexpr const uint32_t MAGIC = 0x33514945;  // "EIQ3"
+
+  // Returns the offset of the plane of the slot of a queue in the partition, or 0 if the slot is not available.
+  // Slots of a queue are counted from skip slots after the first one of the stored queue.
+  uint32_t address(int slot, int plane, uint32_t skip) const {
+    if (!partition_ || slot < 0 || slot >= capacity_) return 0;
+    return offset((index_.first + skip + slot) % capacity_, plane);
+  }
+
+  // Returns the offset of the plane of the physical slot.
+  uint32_t offset(int physical, int plane) const {
+    return partition_ ? SECTOR_SIZE + (2 * physical + plane) * plane_area_ : 0;
+  }
+
+  // Returns the current copy of RETAINED, which is the number of the cleared bits modulo COPIES.
+  int copy() const {
+    return __builtin_popcount(~index_.retained) % COPIES;
+  }
+
+  // Removes the oldest frames of the stored queue, whose slots are about to be reused.
+  bool drop(int count) {
+    index_.first = (index_.first + count) % capacity_;
+    index_.count -= count;
+    memmove(index_.times, index_.times + count, sizeof(uint32_t) * index_.count);
+    return store();
+  }
+
+  bool store() {
+    index_.magic = MAGIC;
+    index_.plane_size = plane_size_;
+    if (esp_partition_erase_range(partition_, 0, SECTOR_SIZE) != ESP_OK) return false;
+    return (esp_partition_write(partition_, 0, &index_, sizeof(index_)) == ESP_OK);
+  }
+
+  const esp_partition_t *partition_;
+  uint32_t plane_size_;
+  uint32_t plane_area_;
+  int capacity_;
+  struct Index {
+    uint32_t magic;
+    uint32_t plane_size;  // Frames of another geometry are not used.
+    uint32_t expires;  // The queue is stale after this time (UNIX time).
+    uint32_t first;  // Physical slot of the first frame.
+    uint32_t count;
+    uint32_t retained;  // Bit mask whose cleared bits count the switches of RETAINED.
+    uint32_t times[CAPACITY];  // Display time of each slot (UNIX time).
+  } index_;
+};
+
+#endif
@@ -0,0 +1,95 @@
+// CPU frequency and WiFi power-save governor switching levels per phase of a wake
+
+#ifndef POWERGOVERNOR_H_
+#define POWERGOVERNOR_H_
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_wifi.h>
+
+class PowerGovernor {
+public:
+  enum Phase {
+    BOOT,  // Before the network is used.
+    CONNECT,  // Waiting for the association and NTP, which need to receive promptly.
+    TRANSFER,  // HTTP and TLS.
+    WAIT,  // Backoff before retrying, when nothing is received.
+    COMPUTE,  // Decoding, hashing and rendering frames.
+    PANEL,  // Sending to the EPD and waiting for its refresh.
+    PHASES
+  };
+
+  PowerGovernor() : phase_(BOOT), mhz_(getCpuFrequencyMhz()), since_(millis()) {
+    for (int i = 0; i < PHASES; i++) phase_time_[i] = 0;
+    for (int i = 0; i < CLOCKS; i++) clock_time_[i] = 0;
+  }
+
+  ~PowerGovernor() {
+  }
+
+  void set(Phase phase) {
+    account();
+    phase_ = phase;
+    const bool wifi = (WiFi.getMode() != WIFI_OFF);
+    uint32_t mhz = level(phase).mhz;
+    if (wifi && mhz < MIN_WIFI_MHZ) mhz = MIN_WIFI_MHZ;  // WiFi stops below 80 MHz.
+    if (mhz != mhz_ && setCpuFrequencyMhz(mhz)) mhz_ = mhz;
+    if (wifi) esp_wifi_set_ps(level(phase).ps);
+  }
+
+  // Returns the time spent in each phase and at each clock (ms).
+  String report() {
+    account();
+    String str = "Phases (ms):";
+    static const char *names[PHASES] = {"boot", "connect", "transfer", "wait", "compute", "panel"};
+    for (int i = 0; i < PHASES; i++) str += String(" ") + names[i] + "=" + String(phase_time_[i]);
+    str += ", clocks (ms):";
+    for (int i = 0; i < CLOCKS; i++) {
+      if (clock_time_[i]) str += " " + String(clockMhz(i)) + "MHz=" + String(clock_time_[i]);
+    }
+    return str;
+  }
+
+private:
+  static constexpr const uint32_t MIN_WIFI_MHZ = 80;
+  static constexpr const int CLOCKS = 4;
+  struct Level {
+    uint32_t mhz;
+    wifi_ps_type_t ps;
+  };
+
+  static const Level &level(Phase phase) {
+    static const Level levels[PHASES] = {
+      {80, WIFI_PS_MIN_MODEM},  // BOOT
+      {80, WIFI_PS_MIN_MODEM},  // CONNECT
+      {240, WIFI_PS_NONE},  // TRANSFER
+      {80, WIFI_PS_MAX_MODEM},  // WAIT
+      {240, WIFI_PS_MIN_MODEM},  // COMPUTE
+      {40, WIFI_PS_MAX_MODEM},  // PANEL
+    };
+    return levels[phase];
+  }
+
+  static uint32_t clockMhz(int i) {
+    static const uint32_t clocks[CLOCKS] = {240, 160, 80, 40};
+    return clocks[i];
+  }
+
+  void account() {
+    const uint32_t now = millis();
+    const uint32_t time = now - since_;
+    since_ = now;
+    phase_time_[phase_] += time;
+    for (int i = 0; i < CLOCKS; i++) {
+      if (clockMhz(i) == mhz_) clock_time_[i] += time;
+    }
+  }
+
+  Phase phase_;
+  uint32_t mhz_;
+  uint32_t since_;
+  uint32_t phase_time_[PHASES];
+  uint32_t clock_time_[CLOCKS];
+};
+
+#endif
@@ -0,0 +1,86 @@
+// Wake-up schedule consisting of time slots
+
+#ifndef SCHEDULE_H_
+#define SCHEDULE_H_
+
+#include <Arduino.h>
+#include <time.h>
+
+class Schedule {
+public:
+  static constexpr const int CAPACITY = 16;
+  static constexpr const int MIN_SLEEP = 3 * 60;  // Minimum sleep time (sec).
+
+  Schedule() : size_(0) {
+  }
+
+  ~Schedule() {
+  }
+
+  // Parses comma separated slots in the form "HH:MM[-HH:MM/MIN][@DAYS]".
+  // A slot wakes up every MIN minutes between the two times on the weekdays listed in DAYS (0: Sunday, ..., 6: Saturday).
+  bool parse(const String &str) {
+    size_ = 0;
+    int pos = 0;
+    while (pos < (int)str.length()) {
+      int end = str.indexOf(',', pos);
+      if (end < 0) end = str.length();
+      String item = str.substring(pos, end);
+      item.trim();
+      pos = end + 1;
+      if (item.length() == 0) continue;
+
+      const char *p = item.c_str();
+      int bh, bm, n;
+      if (sscanf(p, "%d:%d%n", &bh, &bm, &n) != 2) return false;
+      p += n;
+      int eh = bh, em = bm, step = 24 * 60;
+      if (*p == '-') {
+        if (sscanf(p, "-%d:%d/%d%n", &eh, &em, &step, &n) != 3) return false;
+        p += n;
+      }
+      uint8_t days = 0x7f;
+      if (*p == '@') {
+        for (days = 0, p++; *p >= '0' && *p <= '6'; p++) days |= (1 << (*p - '0'));
+      }
+      const int bgn = bh * 60 + bm;
+      const int fin = eh * 60 + em;
+      if (*p != '\0' || bm < 0 || bm >= 60 || em < 0 || em >= 60 || bgn < 0 || bgn >= 24 * 60 || fin < bgn || fin > 24 * 60 || step <= 0) return false;
+      if (size_ < CAPACITY) slots_[size_++] = {(uint16_t)bgn, (uint16_t)fin, (uint16_t)step, days};
+    }
+    return (size_ > 0);
+  }
+
+  // Returns the time until the earliest slot which is at least MIN_SLEEP later than now (sec), or 0 if there is no slot.
+  uint32_t next(const struct tm &now) const {
+    const int cur = (now.tm_hour * 60 + now.tm_min) * 60 + now.tm_sec;
+    int best = -1;
+    for (int d = 0; d <= 7 && best < 0; d++) {  // Slots on later days are never earlier than the ones on this day.
+      const int wday = (now.tm_wday + d) % 7;
+      const int need = cur + MIN_SLEEP - d * 24 * 60 * 60;  // Earliest acceptable time in this day (sec).
+      for (int i = 0; i < size_; i++) {
+        const Slot &slot = slots_[i];
+        if (!(slot.days & (1 << wday))) continue;
+        int t = slot.bgn;
+        if (t * 60 < need) t += (need - t * 60 + slot.step * 60 - 1) / (slot.step * 60) * slot.step;
+        if (t > slot.end) continue;
+        const int sleep = (d * 24 * 60 + t) * 60 - cur;
+        if (best < 0 || sleep < best) best = sleep;
+      }
+    }
+    return (best < 0) ? 0 : best;
+  }
+
+private:
+  struct Slot {
+    uint16_t bgn;  // Minutes from midnight.
+    uint16_t end;
+    uint16_t step;
+    uint8_t days;  // Bit mask of weekdays.
+  };
+
+  Slot slots_[CAPACITY];
+  int size_;
+};
+
+#endif
@@ -0,0 +1,41 @@
+// Upscaler of the planes of frames sent at half resolution, shared by the firmware and the host benchmark
+
+#ifndef UPSCALE_H_
+#define UPSCALE_H_
+
+#include <cstdint>
+#include <cstring>
+
+class Upscale {
+public:
+  // Returns the 4 bit vector magnified to 8 bit.
+  static uint8_t widen(uint8_t nibble) {
+    static const uint8_t scaling[16] = {0x00, 0x03, 0x0c, 0x0f, 0x30, 0x33, 0x3c, 0x3f, 0xc0, 0xc3, 0xcc, 0xcf, 0xf0, 0xf3, 0xfc, 0xff};
+    return scaling[nibble];
+  }
+
+  // Expands the rows at the start of buf, which are half as wide if half_width and half as many if half_height,
+  // into the given number of rows of line_size bytes in place. rows must be even if half_height.
+  // The rows are written from the bottom and each row from the right, so that no source byte is overwritten before it is read.
+  static void expand(uint8_t *buf, int line_size, int rows, bool half_width, bool half_height) {
+    if (!half_width && !half_height) return;
+    const int src_line = half_width ? line_size / 2 : line_size;
+    const int step = half_height ? 2 : 1;
+    for (int row = rows - 1; row >= 0; row -= step) {
+      const uint8_t *src = buf + src_line * (row / step);
+      uint8_t *dst = buf + line_size * row;
+      if (half_width) {
+        for (int i = src_line - 1; i >= 0; i--) {
+          const uint8_t b = src[i];
+          dst[2 * i + 1] = widen(b & 0x0f);
+          dst[2 * i] = widen(b >> 4);
+        }
+      } else {
+        memmove(dst, src, line_size);
+      }
+      if (half_height) memmove(dst - line_size, dst, line_size);  // The row above is the same.
+    }
+  }
+};
+
+#endif
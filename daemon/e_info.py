@@ -2,8 +2,11 @@
 
 from PIL import Image, ImageDraw, ImageFont
 import datetime
+import glob
 import json
+import os
 import requests
+import struct
 import time
 
 WIDTH = 176
@@ -12,6 +15,8 @@ PIXELS = 22
 HPIXELS = PIXELS // 2
 DIRECTORY = '/var/www/html/public/e_info'
 FONT = '/usr/share/fonts/opentype/ipafont-gothic/ipag.ttf'
+HISTORY = 16  # Number of recent frames from which deltas are provided.
+SCALE = (1, 1)  # Divisors of the width and the height of the served frames. (2, 1), (1, 2) or (2, 2) reduce the download of large-type layouts.
 
 class Text:
   def __init__(self, image, draw):
@@ -87,6 +92,97 @@ def get_stock():
     result.append(('DJI  ', '     ?            '))
   return result
 
+# The planes are reduced by SCALE, and the device upscales them by repeating the pixels.
+def save_frame(image, prefix=''):
+  image.save(DIRECTORY + '/' + prefix + 'col.png')
+  reduced = image.resize((WIDTH // SCALE[0], HEIGHT // SCALE[1]), Image.NEAREST)
+  reduced.point(lambda x: int(x != 1), mode='1').save(DIRECTORY + '/' + prefix + 'blk.pbm')
+  reduced.point(lambda x: int(x != 2), mode='1').save(DIRECTORY + '/' + prefix + 'red.pbm')
+
+# Saves frames to be displayed at the given times and their manifest queue.txt for the offline frame queue.
+# frames is a list of (datetime, image) in ascending order of time. The device fetches a new queue after expires.
+def save_queue(frames, expires):
+  lines = ['%d' % int(expires.timestamp())]
+  for i, (when, image) in enumerate(frames):
+    prefix = 'q%03d_' % i
+    save_frame(image, prefix)
+    lines.append('%d %sblk.pbm %sred.pbm' % (int(when.timestamp()), prefix, prefix))
+  with open(DIRECTORY + '/queue.txt.tmp', 'w') as f:
+    f.write('\n'.join(lines) + '\n')
+  os.replace(DIRECTORY + '/queue.txt.tmp', DIRECTORY + '/queue.txt')
+
+def fnv1_hash(data):
+  h = 2166136261
+  for b in data:
+    h = ((16777619 * h) & 0xffffffff) ^ b
+  return h
+
+# Returns the concatenated planes of the saved frame without the PBM headers, upscaled as on the device.
+def read_planes(prefix=''):
+  data = b''
+  for name in ('blk.pbm', 'red.pbm'):
+    plane = Image.open(DIRECTORY + '/' + prefix + name).resize((WIDTH, HEIGHT), Image.NEAREST)
+    data += bytes(b ^ 0xff for b in plane.tobytes())  # 1 is white in PIL, but ink in PBM.
+  return data
+
+# Delta from base to data: b'EID1', hashes of base and data, then runs of (skip, length, XOR data) ending with (0, 0).
+def make_delta(base, data):
+  diff = bytes(a ^ b for a, b in zip(base, data))
+  runs = []
+  i = 0
+  while i < len(diff):
+    if diff[i] == 0:
+      i += 1
+      continue
+    j = i + 1
+    while j < len(diff) and any(diff[j:j + 4]):  # Gaps shorter than the run header are included.
+      j += 1
+    if runs and i - runs[-1][1] < 4:
+      runs[-1][1] = j
+    else:
+      runs.append([i, j])
+    i = j
+  out = bytearray(b'EID1' + struct.pack('<II', fnv1_hash(base), fnv1_hash(data)))
+  pos = 0
+  for bgn, end in runs:
+    while bgn - pos > 0xffff:
+      out += struct.pack('<HH', 0xffff, 0)
+      pos += 0xffff
+    skip = bgn - pos
+    while end - bgn > 0:
+      n = min(end - bgn, 0xffff)
+      out += struct.pack('<HH', skip, n) + diff[bgn:bgn + n]
+      skip = 0
+      bgn += n
+    pos = end
+  out += struct.pack('<HH', 0, 0)
+  return bytes(out)
+
+# Keeps the recent frames in the history directory, and writes the deltas from each of them to the current frame.
+# The device requests delta_<hash>.dat with the hash of the frame on its panel, and fetches the full frame if it is missing.
+def save_deltas(data):
+  history = DIRECTORY + '/history'
+  os.makedirs(history, exist_ok=True)
+  with open('%s/%08x.bin' % (history, fnv1_hash(data)), 'wb') as f:
+    f.write(data)
+  frames = sorted(glob.glob(history + '/*.bin'), key=os.path.getmtime, reverse=True)
+  for path in frames[HISTORY:]:
+    os.remove(path)
+  names = set()
+  for path in frames[:HISTORY]:
+    with open(path, 'rb') as f:
+      base = f.read()
+    if len(base) != len(data):
+      continue
+    name = 'delta_' + os.path.basename(path)[:8] + '.dat'
+    with open(DIRECTORY + '/' + name + '.tmp', 'wb') as f:
+      f.write(make_delta(base, data))
+    os.replace(DIRECTORY + '/' + name + '.tmp', DIRECTORY + '/' + name)
+    names.add(name)
+  for path in glob.glob(DIRECTORY + '/delta_*.dat'):
+    if os.path.basename(path) not in names:
+      os.remove(path)
+
 def main():
   # Initialize
   image = Image.new('P', (WIDTH, HEIGHT))
@@ -121,9 +217,8 @@ def main():
     text.put(7, 9 + i, s[1], 0, True)
 
   # Save images
-  image.save(DIRECTORY + '/col.png')
-  image.point(lambda x: int(x != 1), mode='1').save(DIRECTORY + '/blk.pbm')
-  image.point(lambda x: int(x != 2), mode='1').save(DIRECTORY + '/red.pbm')
+  save_frame(image)
+  save_deltas(read_planes())
 
 if __name__ == '__main__':
   main()
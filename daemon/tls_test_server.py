@@ -0,0 +1,71 @@
+#!/usr/bin/python3
+# Local HTTPS server for testing TLS session resumption of the firmware.
+# Serves the files in a directory, and logs whether each connection resumed a session.
+# The firmware is tested by setting DURL to this server and reading the log over deep sleep wakes.
+# Usage: tls_test_server.py [-p PORT] [-d DIRECTORY] [--check]
+#   --check  connects twice to the running server with the Python client, and reports whether the second handshake was resumed.
+#            This only checks that the server resumes sessions. TLSClient of the firmware is checked against this server
+#            by pc_version/tls_resume_test ("make tls_test" in pc_version) with the desktop mbedtls.
+
+import argparse
+import functools
+import http.server
+import os
+import socket
+import ssl
+import subprocess
+import time
+
+CERT = 'tls_test_server.pem'
+
+def make_cert(path):
+  if os.path.exists(path):
+    return
+  subprocess.run(['openssl', 'req', '-x509', '-newkey', 'rsa:2048', '-nodes', '-days', '3650', '-subj', '/CN=e-info-test', '-keyout', path, '-out', path], check=True, capture_output=True)
+
+class Handler(http.server.SimpleHTTPRequestHandler):
+  def setup(self):
+    super().setup()
+    self.log_message('TLS %s, %s, session %s', self.connection.version(), self.connection.cipher()[0], 'resumed' if self.connection.session_reused else 'full')
+
+def serve(port, directory, cert):
+  make_cert(cert)
+  context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+  context.maximum_version = ssl.TLSVersion.TLSv1_2  # Same as mbedtls 2.x of the firmware.
+  context.load_cert_chain(cert)
+  server = http.server.ThreadingHTTPServer(('', port), functools.partial(Handler, directory=directory))
+  server.socket = context.wrap_socket(server.socket, server_side=True)
+  print('Serving %s on https://localhost:%d/' % (directory, port))
+  server.serve_forever()
+
+def check(port):
+  context = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+  context.check_hostname = False
+  context.verify_mode = ssl.CERT_NONE
+  context.maximum_version = ssl.TLSVersion.TLSv1_2
+  session = None
+  resumed = False
+  for i in range(2):
+    bgn = time.time()
+    with socket.create_connection(('localhost', port)) as sock:
+      with context.wrap_socket(sock, server_hostname='localhost', session=session) as tls:
+        elapsed = (time.time() - bgn) * 1000
+        resumed = tls.session_reused
+        print('Handshake %d: %.1f ms, session %s' % (i + 1, elapsed, 'resumed' if resumed else 'full'))
+        tls.sendall(b'HEAD / HTTP/1.0\r\n\r\n')
+        tls.recv(1024)
+        session = tls.session
+  return 0 if resumed else 1
+
+def main():
+  parser = argparse.ArgumentParser()
+  parser.add_argument('-p', '--port', type=int, default=8443)
+  parser.add_argument('-d', '--directory', default='.')
+  parser.add_argument('--check', action='store_true')
+  args = parser.parse_args()
+  if args.check:
+    exit(check(args.port))
+  serve(args.port, args.directory, CERT)
+
+if __name__ == '__main__':
+  main()
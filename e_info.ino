@@ -5,7 +5,13 @@
 #include <Preferences.h>
 #include <WiFi.h>
 #include <soc/rtc_cntl_reg.h>
+#include "Deadline.h"
 #include "EPDClass.h"
+#include "FrameQueue.h"
+#include "PowerGovernor.h"
+#include "Schedule.h"
+#include "TLSClient.h"
+#include "Upscale.h"
 
 extern "C" int rom_phy_get_vdd33();
 
@@ -17,12 +23,38 @@ constexpr int CS_PIN = 5;
 constexpr int VDD_PIN = 2;
 constexpr int DCDC_PIN = 4;
 constexpr uint32_t font[10] = {0x00eaaae0, 0x00444440, 0x00e8e2e0, 0x00e2e2e0, 0x0022eaa0, 0x00e2e8e0, 0x00eae8e0, 0x00222ae0, 0x00eaeae0, 0x00e2eae0};  // 4x8 font data for digits 0-9.
-constexpr uint8_t scaling[16] = {0x00, 0x03, 0x0c, 0x0f, 0x30, 0x33, 0x3c, 0x3f, 0xc0, 0xc3, 0xcc, 0xcf, 0xf0, 0xf3, 0xfc, 0xff};  // Table for magnifying 4 bit vector to 8 bit.
+using EPD = EPDClass<EPD2in7B>;
+constexpr int BAND_HEIGHT = EPD::HEIGHT;  // Rows processed at once. Frames taller than this are streamed to the EPD while fetching.
+constexpr bool FULL_FRAME = (BAND_HEIGHT >= EPD::HEIGHT);
+constexpr int BAND_SIZE = EPD::LINE_SIZE * (FULL_FRAME ? EPD::HEIGHT : BAND_HEIGHT);
+constexpr int digits(int n) {
+  return (n < 10) ? 1 : 1 + digits(n / 10);
+}
+constexpr int PBM_HEADER_SIZE = 3 + digits(EPD::WIDTH) + 1 + digits(EPD::HEIGHT) + 1;  // "P4\n<width> <height>\n" at full resolution, which is the longest.
+constexpr int PBM_DATA_SIZE = EPD::LINE_SIZE * EPD::HEIGHT;
+constexpr int DATA_ERROR = -100;  // Response was received but its content is not usable.
+constexpr uint32_t READ_TIMEOUT = 5000;  // Timeout for receiving the next byte (ms).
+constexpr int FETCH_RETRIES = 3;  // Number of successive attempts without progress before giving up.
+constexpr uint32_t FRAME_BUDGET = 10000;  // Transfer time added for each frame of the queue (ms).
+constexpr int32_t MIN_HINT_SLEEP = 60;  // Minimum sleep time suggested by the server (sec).
+constexpr int32_t MAX_HINT_SLEEP = 24 * 60 * 60;  // Maximum sleep time suggested by the server (sec), as long as without a schedule.
+constexpr uint32_t VALID_TIME = 1577836800;  // 2020-01-01. The clock is not set since power-on if it is earlier.
+constexpr int HALF_WIDTH = 1;  // Flags of a plane sent at half resolution, which is given by the size in its PBM header.
+constexpr int HALF_HEIGHT = 2;
+static_assert(EPD::WIDTH % 16 == 0 && BAND_SIZE / EPD::LINE_SIZE % 2 == 0, "Half resolution needs whole bytes per row and row pairs per band.");
 
 Preferences preferences;
-EPDClass epd(BUSY_PIN, RST_PIN, DC_PIN, CS_PIN);
-uint8_t buf_blk[5808];
-uint8_t buf_red[5808];
+EPD epd(BUSY_PIN, RST_PIN, DC_PIN, CS_PIN);
+uint8_t buf_blk[BAND_SIZE];
+uint8_t buf_red[FULL_FRAME ? BAND_SIZE : 1];  // Streaming uses buf_blk for both planes.
+float voltage = 0.0f;
+FrameQueue queue(PBM_DATA_SIZE);
+PowerGovernor governor;
+Deadline deadline;
+uint32_t wake_at = 0;  // Wake-up time suggested by the server (millis), or 0.
+RTC_DATA_ATTR uint32_t frame_hash = 0;  // Hash of the retained copy of the frame, or 0 if there is none.
+RTC_DATA_ATTR int shown_battery = -1;  // Battery digits on the panel, or -1 if the panel does not show the retained frame.
+RTC_DATA_ATTR uint32_t shown_queued = 0;  // Time of the queued frame on the panel, or 0 if the panel shows another frame.
 
 void setup() {
   WRITE_PERI_REG(RTC_CNTL_BROWN_OUT_REG, 0);  // Disable brown-out detection.
@@ -30,8 +62,9 @@ void setup() {
   Serial.begin(115200);
   while (!Serial) ;
   Serial.println("E-info firmware");
+  governor.set(PowerGovernor::BOOT);
 
-  const float voltage = getVoltage();
+  voltage = getVoltage();
   Serial.println("Battery voltage: " + String(voltage));
   if (voltage < SHUTDOWN_VOLTAGE) shutdown();
 
@@ -39,13 +72,34 @@ void setup() {
   Serial.println("Hall sensor: " + String(h));
   if (h < 10 || h > 40) config();
   preferences.begin("e_info", true);
+  deadline.begin();
+
+  // Display the due frame of the queue without WiFi, unless the queue is stale or runs dry.
+  if (queue.begin()) {
+    const uint32_t now = epoch();
+    const uint32_t next = queue.next(now);
+    Serial.println("Queued frames: " + String(queue.size()) + ", next: " + String(next));
+    if (now >= VALID_TIME && now < queue.expires() && next > 0) {
+      const int slot = queue.due(now);
+      if (slot >= 0 && queue.time(slot) != shown_queued) show_queued(slot);  // An early wake does not refresh the same frame.
+      deep_sleep(next - now);
+    }
+  }
+
+  // A server or a panel which hung the previous wake is not tried again until the next hour.
+  if (Deadline::overran()) {
+    Serial.println("Reset by the watchdog.");
+    suspend();
+  }
 
   // Enable WiFi.
   WiFi.mode(WIFI_STA);
+  governor.set(PowerGovernor::CONNECT);
+  deadline.start(Deadline::CONNECT);
   WiFi.begin(preferences.getString("SSID").c_str(), preferences.getString("PASS").c_str());
   Serial.print("Connecting WiFi.");
   while (WiFi.status() != WL_CONNECTED) {
-    if (millis() >= 30000) suspend();
+    if (deadline.expired()) suspend();
     delay(500);
     Serial.print(".");
   }
@@ -55,79 +109,132 @@ void setup() {
   const String ntps = preferences.getString("NTPS");
   Serial.println("NTP server: " + ntps);
   configTime(9 * 3600L, 0, ntps.c_str());
-  struct tm time;
-  getLocalTime(&time);
+  struct tm time = {};
+  if (!getLocalTime(&time, deadline.remaining())) Serial.println("NTP timed out.");
   Serial.println("Time: " + String(time.tm_hour) + ":" + String(time.tm_min));
 
   Serial.println("Obtaining the data.");
-  for (int retry = 0; ; retry++) {
-    if (retry == 3) suspend();
-    if (read_data("blk.pbm", buf_blk)) break;
-    delay(3000);
-  }
-  for (int retry = 0; ; retry++) {
-    if (retry == 3) suspend();
-    if (read_data("red.pbm", buf_red)) break;
-    delay(3000);
+  governor.set(PowerGovernor::TRANSFER);
+  deadline.start(Deadline::TRANSFER);
+  if (epoch() >= VALID_TIME && fetch_queue()) {  // The due frame and the sleep are not known without the clock.
+    // Disable WiFi.
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+
+    const uint32_t now = epoch();
+    const int slot = queue.due(now);
+    if (slot >= 0) show_queued(slot);
+    const uint32_t next = queue.next(now);
+    getLocalTime(&time, 0);  // The clock was set by NTP above, if at all.
+    deep_sleep((next > 0) ? next - now : sleep_time(time));
   }
+  if (FULL_FRAME) {
+    int bgn = 0;  // Changed range of the concatenated planes.
+    int end = 2 * PBM_DATA_SIZE;
+    const bool delta = fetch_delta(&bgn, &end);
+    if (!delta && (!fetch_data("blk.pbm", 0, -1) || !fetch_data("red.pbm", 1, -1))) suspend();
 
-  // Disable WiFi.
-  WiFi.disconnect(true);
-  WiFi.mode(WIFI_OFF);
+    // Disable WiFi.
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+    governor.set(PowerGovernor::COMPUTE);
 
-  // Draw battery information in top-right 16x16 area.
-  Serial.println("Drawing battery information.");
-  const int digit0 = (int)(voltage * 10.0) % 10;
-  const int digit1 = (int)(voltage * 100.0 + 0.5) % 10;
-  uint32_t font0 = font[digit0];
-  uint32_t font1 = font[digit1];
-  uint32_t ptr = EPDClass::WIDTH / 8 - 2;
-  for (int i = 0; i < 8; i++) {
-    const uint8_t bmp0 = scaling[font0 & 0xf];
-    const uint8_t bmp1 = scaling[font1 & 0xf];
-    buf_blk[ptr] = bmp0;
-    buf_blk[ptr + 1] = bmp1;
-    buf_red[ptr] = ~bmp0;
-    buf_red[ptr + 1] = ~bmp1;
-    ptr += EPDClass::WIDTH / 8;
-    buf_blk[ptr] = bmp0;
-    buf_blk[ptr + 1] = bmp1;
-    buf_red[ptr] = ~bmp0;
-    buf_red[ptr + 1] = ~bmp1;
-    ptr += EPDClass::WIDTH / 8;
-    font0 >>= 4;
-    font1 >>= 4;
-  }
+    const uint32_t hash = hash_frame();
+    if (!delta && hash == frame_hash) bgn = end = 0;  // The full frame is the same as the retained one.
+    retain_frame(bgn, end, hash);
+    if (bgn == end && battery_digits() == shown_battery) {
+      Serial.println("Frame is unchanged.");
+    } else {
+      // Output to the EPD.
+      Serial.println("Drawing EPD. Changed range: " + String(bgn) + "-" + String(end));
+      draw_battery(0, 0, EPD::HEIGHT, buf_blk);
+      draw_battery(1, 0, EPD::HEIGHT, buf_red);
+      start_panel();
+      epd_power(true);
+      epd.begin();
+      epd.write(buf_blk, buf_red);
+      epd.sleep();
+      epd.end();
+      epd_power(false);
+      shown_battery = epd.timedOut() ? -1 : battery_digits();  // The panel may show anything after a timeout.
+      shown_queued = 0;
+    }
+  } else {
+    // Each band is sent to the EPD as soon as it is received.
+    Serial.println("Streaming to EPD.");
+    epd.setTimeout(deadline.remaining());
+    epd_power(true);
+    epd.begin();
+    epd.beginPlane(0);
+    if (!fetch_data("blk.pbm", 0, -1)) suspend();
+    epd.beginPlane(1);
+    if (!fetch_data("red.pbm", 1, -1)) suspend();
 
-  // Output to the EPD.
-  Serial.println("Drawing EPD.");
-  epd_power(true);
-  epd.begin();
-  epd.write(buf_blk, buf_red);
-  epd.sleep();
-  epd.end();
-  epd_power(false);
+    // Disable WiFi.
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+    start_panel();
+    epd.refresh();
+    epd.sleep();
+    epd.end();
+    epd_power(false);
+    shown_queued = 0;
+  }
 
   // Deep sleep.
-  const int slph = preferences.getString("SLPH").toInt();
-  const int slpm = preferences.getString("SLPM").toInt();
-  int sleep = (slph - time.tm_hour) * 60 + (slpm - time.tm_min);
-  if (sleep < 0) sleep += 24 * 60;
-  if (sleep < 3) sleep = 3;
-  Serial.println("Sleep (hour): " + String(float(sleep) / 60.0));
-  esp_sleep_enable_timer_wakeup((uint64_t)sleep * 60 * 1000 * 1000);
-  esp_deep_sleep_start();
+  getLocalTime(&time, 0);
+  deep_sleep(sleep_time(time));
 }
 
 void loop() {
 }
 
+// Returns the time until the next wake-up (sec).
+uint32_t sleep_time(const struct tm &time) {
+  if (wake_at) {  // The server knows when the next content becomes available.
+    const int32_t sleep = (int32_t)(wake_at - millis()) / 1000;
+    Serial.println("Wake-up hint (sec): " + String(sleep));
+    return max(sleep, MIN_HINT_SLEEP);
+  }
+  String wake = preferences.getString("WAKE");
+  if (!wake.length()) wake = preferences.getString("SLPH") + ":" + preferences.getString("SLPM");  // Single daily slot.
+  Schedule schedule;
+  if (!schedule.parse(wake)) {
+    Serial.println("Invalid schedule: " + wake);
+    return 60 * 60;
+  }
+  const uint32_t sleep = schedule.next(time);
+  return (sleep > 0) ? sleep : 24 * 60 * 60;
+}
+
+void deep_sleep(uint32_t sleep) {
+  Serial.println(governor.report());
+  if (epd.timedOut()) Serial.println("EPD timed out.");
+  Serial.println("Sleep (hour): " + String(float(sleep) / 60.0 / 60.0));
+  esp_sleep_enable_timer_wakeup((uint64_t)sleep * 1000 * 1000);
+  esp_deep_sleep_start();
+}
+
+// Returns the current UNIX time, which is kept by the RTC during deep sleep.
+uint32_t epoch() {
+  return time(nullptr);
+}
+
+// Sleeps early after a failure. The due frame of the queue is displayed instead, even if the queue is stale, unless it is already on the panel.
 void suspend() {
   Serial.println("Suspended.");
   WiFi.disconnect(true);
   WiFi.mode(WIFI_OFF);
-  esp_sleep_enable_timer_wakeup((uint64_t)(1 * 60) * 60 * 1000 * 1000);
-  esp_deep_sleep_start();
+  epd_power(false);  // The EPD is powered while streaming.
+  uint32_t sleep = 1 * 60 * 60;
+  const uint32_t now = epoch();
+  if (now >= VALID_TIME && queue.begin()) {
+    const int slot = queue.due(now);
+    if (slot >= 0 && queue.time(slot) != shown_queued) show_queued(slot);
+    const uint32_t next = queue.next(now);
+    if (next > 0 && next - now < sleep) sleep = next - now;
+  }
+  deep_sleep(sleep);
 }
 
 float getVoltage() {
@@ -142,27 +249,13 @@ float getVoltage() {
 
 void shutdown() {
   Serial.println("Battery voltage is low.");
-
-  // Draw an empty battery icon.
-  for (int i = 0; i < 32; i++) {
-    buf_blk[22 * (i + 40) + 5 + 4] = 0x80;
-    buf_blk[22 * (i + 40) + 21 - 5 - 4] = 0x01;
-  }
-  for (int i = 0; i < 264 - 40 - 40 - 32; i++) {
-    buf_blk[22 * (i + 40 + 32) + 5] = 0x80;
-    buf_blk[22 * (i + 40 + 32) + 21 - 5] = 0x01;
-  }
-  for (int i = 0; i < 4; i++) {
-    buf_blk[22 * 40 + 5 + 4 + i] = 0xff;
-    buf_blk[22 * (40 + 32) + 5 + i] = 0xff;
-    buf_blk[22 * (40 + 32) + 21 - 5 - i] = 0xff;
-  }
-  for (int i = 0; i < 22 - 5 - 5; i++) {
-    buf_blk[22 * (264 - 40 - 1) + 5 + i] = 0xff;
-  }
+  start_panel();
   epd_power(true);
   epd.begin();
-  epd.write(buf_blk, buf_red);
+  epd.draw(buf_blk, BAND_SIZE / EPD::LINE_SIZE, [](int plane, int row, int rows, uint8_t *band) {
+    memset(band, 0, EPD::LINE_SIZE * rows);
+    if (plane == 0) draw_empty_battery(row, rows, band);
+  });
   epd.sleep();
   epd.end();
   epd_power(false);
@@ -171,6 +264,77 @@ void shutdown() {
   esp_deep_sleep_start();  // Sleep indefinitely.
 }
 
+// Displays the frame of the slot, reading it from the flash in bands.
+void show_queued(int slot) {
+  Serial.println("Drawing queued frame: " + String(slot));
+  shown_battery = -1;
+  shown_queued = queue.time(slot);  // Set before drawing, not to be retried if the panel hangs.
+  start_panel();
+  epd_power(true);
+  epd.begin();
+  epd.draw(buf_blk, BAND_SIZE / EPD::LINE_SIZE, [slot](int plane, int row, int rows, uint8_t *band) {
+    queue.read(slot, plane, EPD::LINE_SIZE * row, band, EPD::LINE_SIZE * rows);
+    draw_battery(plane, row, rows, band);
+  });
+  epd.sleep();
+  epd.end();
+  epd_power(false);
+}
+
+// Starts the panel phase, whose budget limits the busy waits of the EPD.
+void start_panel() {
+  governor.set(PowerGovernor::PANEL);
+  deadline.start(Deadline::PANEL);
+  epd.setTimeout(deadline.remaining());
+}
+
+// Returns the two digits of the battery voltage to be displayed.
+int battery_digits() {
+  return (int)(voltage * 10.0) % 10 * 10 + (int)(voltage * 100.0 + 0.5) % 10;
+}
+
+// Draws the battery voltage in the top-right 16x16 area of the rows from row in the band.
+void draw_battery(int plane, int row, int rows, uint8_t *band) {
+  const int digit0 = battery_digits() / 10;
+  const int digit1 = battery_digits() % 10;
+  for (int y = max(row, 0); y < min(row + rows, 16); y++) {
+    uint8_t bmp0 = Upscale::widen((font[digit0] >> (y / 2 * 4)) & 0xf);
+    uint8_t bmp1 = Upscale::widen((font[digit1] >> (y / 2 * 4)) & 0xf);
+    if (plane != 0) {
+      bmp0 = ~bmp0;
+      bmp1 = ~bmp1;
+    }
+    const int ptr = EPD::LINE_SIZE * (y - row) + EPD::LINE_SIZE - 2;
+    band[ptr] = bmp0;
+    band[ptr + 1] = bmp1;
+  }
+}
+
+// Draws an empty battery icon, 40 rows and 5 bytes inside the edges, in the rows from row of the band.
+void draw_empty_battery(int row, int rows, uint8_t *band) {
+  constexpr int W = EPD::LINE_SIZE;
+  constexpr int H = EPD::HEIGHT;
+  for (int y = row; y < row + rows; y++) {
+    uint8_t *line = band + W * (y - row);
+    if (y == 40) {  // Top of the terminal.
+      for (int i = 0; i < 4; i++) line[5 + 4 + i] = 0xff;
+    } else if (y > 40 && y < 40 + 32) {  // Sides of the terminal.
+      line[5 + 4] = 0x80;
+      line[W - 1 - 5 - 4] = 0x01;
+    } else if (y == 40 + 32) {  // Top of the body.
+      for (int i = 0; i < 4; i++) {
+        line[5 + i] = 0xff;
+        line[W - 1 - 5 - i] = 0xff;
+      }
+    } else if (y > 40 + 32 && y < H - 40 - 1) {  // Sides of the body.
+      line[5] = 0x80;
+      line[W - 1 - 5] = 0x01;
+    } else if (y == H - 40 - 1) {  // Bottom of the body.
+      for (int i = 0; i < W - 5 - 5; i++) line[5 + i] = 0xff;
+    }
+  }
+}
+
 void epd_power(bool enable) {
   if (enable) {
     pinMode(VDD_PIN, OUTPUT);
@@ -268,20 +432,291 @@ String url_decode(const String &str) {
   return result;
 }
 
-bool read_data(const String &file, uint8_t *data) {
-  const String url = preferences.getString("DURL");
+// Returns the FNV-1 hash of the planes in the frame buffers.
+uint32_t hash_frame() {
+  uint32_t hash = 2166136261U;
+  for (int i = 0; i < PBM_DATA_SIZE; i++) hash = (16777619U * hash) ^ buf_blk[i];
+  for (int i = 0; i < PBM_DATA_SIZE; i++) hash = (16777619U * hash) ^ buf_red[i];
+  return hash;
+}
+
+// Loads the retained copy of the frame into the frame buffers, and applies the delta from it fetched from the server.
+// The delta consists of "EID1", the hashes of the retained and the new frames, and runs of (skip, length, XOR data)
+// over the concatenated planes ending with (0, 0). Numbers are in little endian, and lengths are 16 bit.
+// Sets the changed range of the planes. Returns false if a full frame has to be fetched.
+bool fetch_delta(int *bgn, int *end) {
+  if (frame_hash == 0 || !queue.begin()) return false;
+  if (!queue.read(FrameQueue::RETAINED, 0, 0, buf_blk, PBM_DATA_SIZE) || !queue.read(FrameQueue::RETAINED, 1, 0, buf_red, PBM_DATA_SIZE) || hash_frame() != frame_hash) return false;
+  char file[24];
+  snprintf(file, sizeof(file), "delta_%08lx.dat", (unsigned long)frame_hash);
+  TLSClient tls;  // Outlives the HTTPClient which stops it.
   HTTPClient client;
-  Serial.println("Fetching the URL: " + url + file);
-  client.begin(url + file);
+  Serial.println("Fetching the file: " + String(file));
+  begin_request(client, tls, file);
   const int res = client.GET();
   Serial.println("Response: " + String(res));
+  read_hint(client);
   if (res != HTTP_CODE_OK) return false;
-  const String &page = client.getString();
-  Serial.println("Data size: " + String(page.length()));
-  if (page.length() != 5808 + 11) return false;
-  Serial.println("Data ID: " + page.substring(0, 11));
-  if (page.substring(0, 11) != "P4\n176 264\n") return false;
-  Serial.println("Copying the data.");
-  memcpy(data, page.c_str() + 11, 5808);  // getBytes() cannot copy binary data since it uses strncpy().
+  uint8_t header[12];
+  if (read_stream(client, header, sizeof(header)) != (int)sizeof(header) || memcmp(header, "EID1", 4) != 0) return false;
+  uint32_t base, hash;
+  memcpy(&base, header + 4, 4);
+  memcpy(&hash, header + 8, 4);
+  if (base != frame_hash) return false;
+  int changed_bgn = 2 * PBM_DATA_SIZE;  // Set to the arguments only on success, since the full frame is fetched otherwise.
+  int changed_end = 0;
+  for (int pos = 0; ; ) {
+    uint8_t run[4];
+    if (read_stream(client, run, sizeof(run)) != (int)sizeof(run)) return false;
+    const int skip = run[0] | (run[1] << 8);
+    int len = run[2] | (run[3] << 8);
+    if (skip == 0 && len == 0) break;
+    pos += skip;
+    if (pos + len > 2 * PBM_DATA_SIZE) return false;
+    if (len > 0) {
+      changed_bgn = min(changed_bgn, pos);
+      changed_end = max(changed_end, pos + len);
+    }
+    while (len > 0) {
+      uint8_t diff[64];
+      const int n = min(len, (int)sizeof(diff));
+      if (read_stream(client, diff, n) != n) return false;
+      for (int i = 0; i < n; i++, pos++) {
+        if (pos < PBM_DATA_SIZE) buf_blk[pos] ^= diff[i]; else buf_red[pos - PBM_DATA_SIZE] ^= diff[i];
+      }
+      len -= n;
+    }
+  }
+  if (hash_frame() != hash) return false;  // The frame buffers are overwritten by the full frame.
+  if (changed_bgn >= changed_end) changed_bgn = changed_end = 0;
+  *bgn = changed_bgn;
+  *end = changed_end;
+  Serial.println("Delta applied: " + String(*bgn) + "-" + String(*end));
   return true;
 }
+
+// Writes the frame into the next copy of the retained frame if the range [bgn, end) of the planes has changed, and records its hash.
+// The current copy stays valid until the new one is complete.
+void retain_frame(int bgn, int end, uint32_t hash) {
+  if (!queue.begin()) return;
+  if (bgn < end) {
+    if (!queue.write(FrameQueue::RETAINED, 0, 0, buf_blk, PBM_DATA_SIZE) || !queue.write(FrameQueue::RETAINED, 1, 0, buf_red, PBM_DATA_SIZE) || !queue.retain()) return;
+  }
+  frame_hash = hash;
+}
+
+// Downloads the frames listed in the manifest into the queue. Returns false if there is no usable manifest.
+// The manifest has the expiry time in its first line, then "<time> <black file> <red file>" lines in ascending order of time.
+// Times are in UNIX time, and the frames older than the due one are skipped.
+bool fetch_queue() {
+  if (!queue.begin()) return false;
+  String manifest;
+  if (read_text("queue.txt", &manifest) != HTTP_CODE_OK) return false;
+  const uint32_t now = epoch();
+  uint32_t expires = 0;
+  uint32_t times[FrameQueue::CAPACITY];
+  int count = 0;
+  int due = 0;  // Frames whose time has come, of which only the last one is kept.
+  int listed = 0;  // Frames in the manifest.
+  for (int pass = 0; pass < 2; pass++) {  // The first pass counts the due frames.
+    int line = 0;
+    int index = 0;
+    for (int pos = 0; pos < (int)manifest.length(); ) {
+      int end = manifest.indexOf('\n', pos);
+      if (end < 0) end = manifest.length();
+      const String item = manifest.substring(pos, end);
+      pos = end + 1;
+      unsigned long time;
+      char blk[64], red[64];
+      if (line++ == 0) {
+        expires = item.toInt();
+      } else if (sscanf(item.c_str(), "%lu %63s %63s", &time, blk, red) == 3) {
+        if (pass == 0) {
+          if (time <= now) due++;
+          listed++;
+        } else if (index++ >= due - 1 && count < queue.capacity()) {
+          if (!fetch_data(blk, 0, count) || !fetch_data(red, 1, count)) break;
+          times[count++] = time;
+        }
+      }
+    }
+    if (pass == 0) deadline.extend(FRAME_BUDGET * min(listed - max(due - 1, 0), queue.capacity()));  // A long queue is not cut off by the budget of a single fetch.
+  }
+  Serial.println("Downloaded frames: " + String(count) + ", expires: " + String(expires));
+  return (count > 0 && queue.commit(times, count, expires));
+}
+
+// Fetches the plane into the frame buffer, the EPD (slot < 0), or the slot of the queue. Returns false on failure.
+bool fetch_data(const String &file, int plane, int slot) {
+  String etag;
+  int ofst = 0;
+  int scale = 0;
+  int retry = 0;
+  while (true) {
+    const int prev = ofst;
+    const int res = read_data(file, plane, slot, &ofst, &etag, &scale);
+    if (ofst == data_size(scale)) return true;
+    if (ofst > prev) retry = 0; else retry++;  // Attempts which made progress are not counted.
+    const uint32_t wait = backoff(res, retry);
+    if (retry >= FETCH_RETRIES || wait == 0 || wait >= deadline.remaining()) return false;
+    Serial.println("Retrying in " + String(wait) + " ms.");
+    governor.set(PowerGovernor::WAIT);
+    delay(wait);
+    governor.set(PowerGovernor::TRANSFER);
+  }
+}
+
+// Returns the waiting time before the next attempt (ms), or 0 if retrying is useless.
+uint32_t backoff(int res, int retry) {
+  uint32_t wait;
+  if (res == HTTPC_ERROR_READ_TIMEOUT || res == HTTPC_ERROR_CONNECTION_LOST || res == HTTP_CODE_RANGE_NOT_SATISFIABLE) {
+    wait = 500;  // The transfer was cut off, and can be resumed soon.
+  } else if ((res < 0 && res != DATA_ERROR) || res >= 500) {
+    wait = 3000;  // The server is unreachable or busy.
+  } else {
+    return 0;  // Client errors and malformed data are not fixed by retrying.
+  }
+  wait <<= retry;
+  const int rssi = WiFi.RSSI();
+  Serial.println("RSSI: " + String(rssi));
+  if (rssi < -80) wait *= 4;  // Weak signal needs time to recover.
+  else if (rssi < -70) wait *= 2;
+  return wait;
+}
+
+// Starts a request for the file under DURL, using tls if it is HTTPS. The request is limited to the time left in the phase.
+void begin_request(HTTPClient &client, TLSClient &tls, const String &file) {
+  static const String url = preferences.getString("DURL");
+  static const String cert = preferences.getString("CERT");  // CA certificate in PEM to verify the server.
+  const uint32_t remaining = deadline.remaining();
+  if (url.startsWith("https:")) {
+    if (cert.length()) tls.setCACert(cert.c_str());
+    tls.setHandshakeTimeout(remaining);
+    client.begin(tls, url + file);
+  } else {
+    client.begin(url + file);
+  }
+  static const char *headers[] = {"ETag", "X-Next-Wake"};
+  client.collectHeaders(headers, 2);
+  client.setConnectTimeout(remaining);
+  client.setTimeout(min(remaining, READ_TIMEOUT));  // Also limits getString().
+}
+
+// Keeps the wake-up time suggested in the response.
+void read_hint(HTTPClient &client) {
+  const int32_t hint = client.header("X-Next-Wake").toInt();  // Time until the next content becomes available (sec).
+  if (hint > 0) wake_at = millis() + (uint32_t)min(hint, MAX_HINT_SLEEP) * 1000;  // Longer hints would wrap around.
+}
+
+// Fetches a text file. Returns the HTTP response code or an error code.
+int read_text(const String &file, String *text) {
+  TLSClient tls;  // Outlives the HTTPClient which stops it.
+  HTTPClient client;
+  Serial.println("Fetching the file: " + file);
+  begin_request(client, tls, file);
+  const int res = client.GET();
+  Serial.println("Response: " + String(res));
+  read_hint(client);
+  if (res == HTTP_CODE_OK) *text = client.getString();
+  return res;
+}
+
+// Returns the PBM header of a plane at the scale.
+String pbm_header(int scale) {
+  return "P4\n" + String((scale & HALF_WIDTH) ? EPD::WIDTH / 2 : EPD::WIDTH) + " " + String((scale & HALF_HEIGHT) ? EPD::HEIGHT / 2 : EPD::HEIGHT) + "\n";
+}
+
+// Returns the size of the data of a plane at the scale.
+int data_size(int scale) {
+  return PBM_DATA_SIZE / ((scale & HALF_WIDTH) ? 2 : 1) / ((scale & HALF_HEIGHT) ? 2 : 1);
+}
+
+// Fetches the PBM file of the plane, resuming after the first *ofst bytes which were already received.
+// A plane at half resolution is upscaled band by band, and *scale keeps its flags between the attempts.
+// The data is kept in the frame buffer, sent to the EPD in bands when streaming, or stored in the slot of the queue.
+// Returns the HTTP response code or an error code.
+int read_data(const String &file, int plane, int slot, int *ofst, String *etag, int *scale) {
+  TLSClient tls;  // Outlives the HTTPClient which stops it.
+  HTTPClient client;
+  Serial.println("Fetching the file: " + file + " from " + String(*ofst));
+  begin_request(client, tls, file);
+  if (*ofst > 0) {
+    client.addHeader("Range", "bytes=" + String(pbm_header(*scale).length() + *ofst) + "-");
+    if (etag->length()) client.addHeader("If-Range", *etag);  // The whole file is sent if it was updated.
+  }
+  const int res = client.GET();
+  Serial.println("Response: " + String(res));
+  if (tls.handshakeTime() > 0) Serial.println("TLS handshake (ms): " + String(tls.handshakeTime()) + (tls.resumed() ? " resumed" : " full") + ", last full: " + String(TLSClient::lastHandshakeTime(false)));
+  read_hint(client);
+  if (res == HTTP_CODE_OK || res == HTTP_CODE_RANGE_NOT_SATISFIABLE) {
+    if (!FULL_FRAME && slot < 0 && *ofst > 0) epd.beginPlane(plane);  // The rows already sent are overwritten from the top.
+    *ofst = 0;
+    *etag = client.header("ETag");
+  }
+  if (res != HTTP_CODE_OK && (res != HTTP_CODE_PARTIAL_CONTENT || *ofst == 0)) {
+    return res;
+  }
+  int header = 0;
+  if (res == HTTP_CODE_OK) {
+    // The header ends at the second line feed, and its size tells the scale.
+    char pbm[PBM_HEADER_SIZE + 1];
+    int lines = 0;
+    while (lines < 2 && header < PBM_HEADER_SIZE) {
+      if (read_stream(client, (uint8_t *)pbm + header, 1) != 1) return HTTPC_ERROR_READ_TIMEOUT;
+      if (pbm[header++] == '\n') lines++;
+    }
+    pbm[header] = '\0';
+    for (*scale = 0; *scale < 4 && pbm_header(*scale) != pbm; (*scale)++) ;
+    if (*scale == 4) {
+      *scale = 0;
+      return DATA_ERROR;
+    }
+  }
+  const int total = data_size(*scale);
+  const int size = client.getSize();
+  Serial.println("Data size: " + String(size) + ", scale: " + String(*scale));
+  if (size >= 0 && size != header + total - *ofst) return DATA_ERROR;
+  const bool half_width = (*scale & HALF_WIDTH);
+  const bool half_height = (*scale & HALF_HEIGHT);
+  const int src_line = half_width ? EPD::LINE_SIZE / 2 : EPD::LINE_SIZE;
+  const int band = BAND_SIZE / (half_width ? 2 : 1) / (half_height ? 2 : 1);  // Bytes of the received data per band.
+  uint8_t *data = (FULL_FRAME && plane != 0) ? buf_red : buf_blk;
+  while (*ofst < total) {
+    const int pos = *ofst % band;  // A band cut off by an error is completed by the next attempt.
+    const int want = min(band - pos, total - *ofst);
+    const int len = read_stream(client, data + pos, want);
+    *ofst += len;
+    if (len < want) break;
+    const int rows = (pos + len) / src_line * (half_height ? 2 : 1);
+    const int row = (*ofst - pos - len) / src_line * (half_height ? 2 : 1);
+    Upscale::expand(data, EPD::LINE_SIZE, rows, half_width, half_height);
+    if (slot >= 0) {
+      if (!queue.write(slot, plane, EPD::LINE_SIZE * row, data, EPD::LINE_SIZE * rows)) return DATA_ERROR;
+    } else if (!FULL_FRAME) {
+      draw_battery(plane, row, rows, data);
+      epd.writeBand(plane, data, EPD::LINE_SIZE * rows);
+    }
+  }
+  Serial.println("Received: " + String(*ofst));
+  return (*ofst == total) ? res : HTTPC_ERROR_READ_TIMEOUT;
+}
+
+// Reads up to size bytes of the response body, and returns the number of bytes read.
+int read_stream(HTTPClient &client, uint8_t *buf, int size) {
+  WiFiClient *stream = client.getStreamPtr();
+  int len = 0;
+  uint32_t last = millis();
+  while (len < size) {
+    const int avail = stream->available();
+    if (avail > 0) {
+      const int n = stream->read(buf + len, min(avail, size - len));
+      if (n > 0) len += n;
+      last = millis();
+    } else if (!stream->connected() || millis() - last >= READ_TIMEOUT || deadline.expired()) {
+      break;
+    } else {
+      delay(1);
+    }
+  }
+  return len;
+}
@@ -0,0 +1,67 @@
+#include "Render.h"
+
+void Render::draw(const uint8_t *text, const uint8_t *attr, const uint16_t *font, uint8_t *buf_blk, uint8_t *buf_red) {
+  uint16_t bmp_blk[Script::WIDTH];
+  uint16_t bmp_red[Script::WIDTH];
+
+  for (int ty = 0; ty < Script::HEIGHT; ty++) {
+    for (int h = 0; h < Script::PIXELS; h++) {
+      int tx = 0;
+      // Copy the font bitmap for one line.
+      for (int w = 0; w < Script::WIDTH; w++) {
+        const uint8_t a = attr[2 * Script::WIDTH * ty + tx];
+        const uint8_t c = text[2 * Script::WIDTH * ty + tx++];
+        uint16_t f;
+        if (a & 0x04) {
+          const uint8_t cc = 0xd0 + ((c - 0x20) >> 1);
+          const uint8_t d = text[2 * Script::WIDTH * ty + tx++];
+          const uint8_t dd = 0xd0 + ((d - 0x20) >> 1);
+          if (c & 0x01) {
+            f = (font[Script::PIXELS * cc + h] << 6);
+          } else {
+            f = (font[Script::PIXELS * cc + h] & 0xf800);;
+          }
+          if (d & 0x01) {
+            f |= (font[Script::PIXELS * dd + h] & 0x03e0);
+          } else {
+            f |= (font[Script::PIXELS * dd + h] >> 6);;
+          }
+        } else {
+          f = font[Script::PIXELS * c + h];
+        }
+        if (a & 0x02) {
+          f = ~f;
+        }
+        if (a & 0x01) {
+          bmp_blk[w] = 0x00;
+          bmp_red[w] = (f & 0xffe0);
+        } else {
+          bmp_blk[w] = (f & 0xffe0);
+          bmp_red[w] = 0x00;
+        }
+      }
+
+      // Render the font to the screen buffer.
+      int ptr = (WIDTH / 8) * (Script::PIXELS * ty + h);
+      int size = 8;
+      uint8_t acc_blk = 0x00;
+      uint8_t acc_red = 0x00;
+      for (int w = 0; w < Script::WIDTH; w++) {
+        acc_blk |= (uint8_t)(bmp_blk[w] >> (16 - size));
+        acc_red |= (uint8_t)(bmp_red[w] >> (16 - size));
+        buf_blk[ptr] = acc_blk;
+        buf_red[ptr] = acc_red;
+        ptr++;
+        if (11 - size >= 8) {
+          buf_blk[ptr] = (uint8_t)((bmp_blk[w] >> (16 - size - 8)) & 0x00ff);
+          buf_red[ptr] = (uint8_t)((bmp_red[w] >> (16 - size - 8)) & 0x00ff);
+          ptr++;
+          size += 8;
+        }
+        acc_blk = (uint8_t)((bmp_blk[w] << size) >> 8);
+        acc_red = (uint8_t)((bmp_red[w] << size) >> 8);
+        size = 8 - (11 - size);
+      }
+    }
+  }
+}
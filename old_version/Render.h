@@ -0,0 +1,20 @@
+// Renderer of the Script screen into the EPD frame buffers, shared by the device and the host tools.
+
+#ifndef RENDER_H_
+#define RENDER_H_
+
+#include <cstdint>
+#include "Script.h"
+
+class Render {
+ public:
+  constexpr static const int WIDTH = 176;
+  constexpr static const int HEIGHT = 264;
+  constexpr static const int FRAME_SIZE = WIDTH / 8 * HEIGHT;  // Bytes of each plane. Bit 1 is ink.
+  constexpr static const int FONT_SIZE = 256 * Script::PIXELS * 2;  // Bytes of the font: 16 bit rows of 11 pixels for 256 characters.
+
+  // Draws the text and the attributes given by Script::getScreen() with the font.
+  static void draw(const uint8_t *text, const uint8_t *attr, const uint16_t *font, uint8_t *buf_blk, uint8_t *buf_red);
+};
+
+#endif
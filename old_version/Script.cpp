@@ -3,71 +3,212 @@
 #define MBEDTLS_X509_ALLOW_UNSUPPORTED_CRITICAL_EXTENSION
 #define MBEDTLS_TLS_DEFAULT_ALLOW_SHA1_IN_CERTIFICATES
 #include "HTTPClient.h"
+#include "TLSClient.h"
+#else
+#include <spawn.h>
+#include <sys/wait.h>
 #endif
 
+Value::Value(const char *s, size_t n) : bgn_(0), len_(n), buf_{0} {
+  if (n <= INLINE_SIZE_) {
+    memcpy(buf_, s, n);
+    buf_[n] = '\0';
+  } else {
+    String str;
+    str.reserve(n);
+    str.concat(s, n);
+    str_ = std::make_shared<const String>(std::move(str));
+  }
+}
+
+Value::Value(String &&s) : bgn_(0), len_(s.length()), buf_{0} {
+  if (len_ <= INLINE_SIZE_) {
+    memcpy(buf_, s.c_str(), len_ + 1);
+  } else {
+    str_ = std::make_shared<const String>(std::move(s));
+  }
+}
+
+// Returns the characters in [bgn, end) in the same manner as String::substring() without copying them.
+Value Value::slice(size_t bgn, size_t end) const {
+  if (bgn > end) std::swap(bgn, end);
+  if (bgn >= len_) return Value();
+  if (end > len_) end = len_;
+  if (end - bgn <= INLINE_SIZE_) return Value(data() + bgn, end - bgn);
+  Value v;
+  v.str_ = str_;
+  v.bgn_ = bgn_ + bgn;
+  v.len_ = end - bgn;
+  return v;
+}
+
+int Value::indexOf(const Value &sub, size_t from) const {
+  if (from > len_) return -1;
+  const void *p = memmem(data() + from, len_ - from, sub.data(), sub.len_);
+  return p ? (const char *)p - data() : -1;
+}
+
+int Value::lastIndexOf(const Value &sub) const {
+  if (sub.len_ == 0 || sub.len_ > len_) return -1;
+  const char *p = data();
+  const char *q = sub.data();
+  for (size_t i = len_ - sub.len_ + 1; i-- > 0; ) {
+    if (p[i] == q[0] && memcmp(p + i, q, sub.len_) == 0) return i;
+  }
+  return -1;
+}
+
+// Replaces all occurrences in one pass, so that the result is built in linear time.
+Value Value::replace(const Value &before, const Value &after) const {
+  if (before.len_ == 0) return *this;
+  int pos = indexOf(before);
+  if (pos < 0) return *this;
+  String str;
+  str.reserve(len_);
+  size_t bgn = 0;
+  for (; pos >= 0; pos = indexOf(before, bgn)) {
+    str.concat(data() + bgn, pos - bgn);
+    str.concat(after.data(), after.len_);
+    bgn = pos + before.len_;
+  }
+  str.concat(data() + bgn, len_ - bgn);
+  return Value(std::move(str));
+}
+
+// Parses the number in the same manner as atol(), without terminating the slice.
+long Value::toInt() const {
+  const char *p = data();
+  size_t i = 0;
+  while (i < len_ && (p[i] == ' ' || p[i] == '\t' || p[i] == '\r' || p[i] == '\n')) i++;
+  const bool neg = (i < len_ && p[i] == '-');
+  if (i < len_ && (p[i] == '-' || p[i] == '+')) i++;
+  long x = 0;
+  for (; i < len_ && p[i] >= '0' && p[i] <= '9'; i++) x = 10 * x + (p[i] - '0');
+  return neg ? -x : x;
+}
+
+float Value::toFloat() const {
+  char buf[32];
+  const size_t n = (len_ < sizeof(buf)) ? len_ : sizeof(buf) - 1;
+  memcpy(buf, data(), n);
+  buf[n] = '\0';
+  return atof(buf);
+}
+
+String Value::str() const {
+  if (str_ && bgn_ == 0 && len_ == str_->length()) return *str_;
+  String str;
+  str.reserve(len_);
+  str.concat(data(), len_);
+  return str;
+}
+
+Value Value::operator+(const Value &x) const {
+  if (x.len_ == 0) return *this;
+  if (len_ == 0) return x;
+  String str;
+  str.reserve(len_ + x.len_);
+  str.concat(data(), len_);
+  str.concat(x.data(), x.len_);
+  return Value(std::move(str));
+}
+
 namespace {
 
+// Names of the built-in operations for the profiler.
+constexpr const char *OPS[] = {
+  "literal", "{", "?", "dup", "drop", "swap", "read", "write", "add", "sub", "mul", "div", "mod", "and", "or", "lt", "le", "gt", "ge", "eq", "ne",
+  "length", "concat", "substr", "find", "rfind", "replace", "format", "extract", "lookup", "print", "wget", "date", "battery", "wakeup",
+};
+constexpr int OP_LITERAL = 0;
+constexpr int OP_WGET = 31;
+
+constexpr bool equals(const char *a, const char *b) {
+  return (*a == *b) && (*a == '\0' || equals(a + 1, b + 1));
+}
+static_assert(equals(OPS[OP_LITERAL], "literal") && equals(OPS[OP_WGET], "wget"), "Indexes do not match the names of the operations.");
+
 #ifdef ARDUINO
-void getHTTP(const String &url, String *page) {
+uint32_t getMicros() {
+  return micros();
+}
+
+void getHTTP(const String &url, String *page, const String &profile) {
   Serial.println("Fetching the URL: " + url);
+  TLSClient tls;  // Outlives the HTTPClient which stops it.
   HTTPClient client;
-  client.begin(url);
+  if (url.startsWith("https:")) {
+    client.begin(tls, url);
+  } else {
+    client.begin(url);
+  }
   client.addHeader("Accept", "*/*");
+  if (profile.length()) client.addHeader("X-E-Info-Profile", profile);
   const int res = client.GET();
   Serial.println("Response: " + String(res));
   if (res == HTTP_CODE_OK) {
     *page = client.getString();
     Serial.println("Page size: " + String(page->length()));
   }
+  if (tls.handshakeTime() > 0) Serial.println("TLS handshake (ms): " + String(tls.handshakeTime()) + (tls.resumed() ? " resumed" : " full"));
 }
 #else
-uint32_t fnv1Hash(uint8_t *data, size_t size) {
+uint32_t getMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint32_t fnv1Hash(const uint8_t *data, size_t size) {
   uint32_t hash = 2166136261U;
   while (size--) hash = (16777619U * hash) ^ *data++;
   return hash;
 }
+
+// Fetches the URL into the file with curl, which is run without a shell so that the URL is not interpreted.
+bool fetchHTTP(const std::string &url, const std::string &file) {
+  std::cerr << "Fetching the URL: " << url << "\n";
+  const char *argv[] = {"curl", "-s", "-f", "-L", "-o", file.c_str(), "--", url.c_str(), nullptr};
+  pid_t pid;
+  if (posix_spawnp(&pid, "curl", nullptr, nullptr, (char *const *)argv, environ) != 0) return false;
+  int status;
+  if (waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0) return true;
+  std::remove(file.c_str());  // Does not leave a partial page in the cache.
+  return false;
+}
 #endif
 
-String unescapeString(const String &str, size_t bgn, size_t end) {
-  if (end <= bgn || end > str.length()) return "";
+int hexDigit(char c) {
+  return ((c <= '9') ? c - '0' : c + 10 - 'a') & 0x0f;
+}
+
+Value unescapeString(const Value &str, size_t bgn, size_t end) {
+  if (end <= bgn || end > str.length()) return Value();
+  if (!memchr(str.data() + bgn, '\\', end - bgn)) return str.slice(bgn, end);  // Nothing to unescape.
 
-  constexpr int buf_size = 1024;
-  static char buf_mem[buf_size];
-  char *buf = buf_mem;
-  for (size_t ptr = bgn; ptr < end && buf - buf_mem + 1 < buf_size; ptr++) {
+  String buf;
+  buf.reserve(end - bgn);  // Unescaping never makes the string longer.
+  for (size_t ptr = bgn; ptr < end; ptr++) {
     const char c = str[ptr];
     if (c == '\\' && ptr + 1 < end) {
       const char d = str[++ptr];
       if (d == 'x' && ptr + 2 < end) {
-        int e0 = str[++ptr];
-        int e1 = str[++ptr];
-        if (e0 <= '9') e0 -= '0'; else e0 += 10 - 'a';
-        if (e1 <= '9') e1 -= '0'; else e1 += 10 - 'a';
-        *buf++ = ((e0 << 4) | e1);
-      } else if (d == 'u' && ptr + 4 < end && buf - buf_mem + 4 < buf_size) {
-        int e0 = str[++ptr];
-        int e1 = str[++ptr];
-        int e2 = str[++ptr];
-        int e3 = str[++ptr];
-        if (e0 <= '9') e0 -= '0'; else e0 += 10 - 'a';
-        if (e1 <= '9') e1 -= '0'; else e1 += 10 - 'a';
-        if (e2 <= '9') e2 -= '0'; else e2 += 10 - 'a';
-        if (e3 <= '9') e3 -= '0'; else e3 += 10 - 'a';
+        const int e0 = hexDigit(str[++ptr]);
+        const int e1 = hexDigit(str[++ptr]);
+        buf.concat((char)((e0 << 4) | e1));
+      } else if (d == 'u' && ptr + 4 < end) {
+        const int e0 = hexDigit(str[++ptr]);
+        const int e1 = hexDigit(str[++ptr]);
+        const int e2 = hexDigit(str[++ptr]);
+        const int e3 = hexDigit(str[++ptr]);
         const int f = ((e0 << 12) | (e1 << 8) | (e2 << 4) | e3);
         if (f <= 0x7f) {
-          *buf++ = (c & 0x7f);
+          buf.concat((char)f);
         } else if (f <= 0x7ff) {
-          *buf++ = (0xc0 | (f >> 6));
-          *buf++ = (0x80 | (f & 0x3f));
-        } else if (f <= 0xffff) {
-          *buf++ = (0xe0 | (f >> 12));
-          *buf++ = (0x80 | ((f >> 6) & 0x3f));
-          *buf++ = (0x80 | (f & 0x3f));
+          buf.concat((char)(0xc0 | (f >> 6)));
+          buf.concat((char)(0x80 | (f & 0x3f)));
         } else {
-          *buf++ = (0xf0 | (f >> 18));
-          *buf++ = (0x80 | ((f >> 12) & 0x3f));
-          *buf++ = (0x80 | ((f >> 6) & 0x3f));
-          *buf++ = (0x80 | (f & 0x3f));
+          buf.concat((char)(0xe0 | (f >> 12)));
+          buf.concat((char)(0x80 | ((f >> 6) & 0x3f)));
+          buf.concat((char)(0x80 | (f & 0x3f)));
         }
       } else {
         char x = d;
@@ -76,23 +217,21 @@ String unescapeString(const String &str, size_t bgn, size_t end) {
         else if (d == 'n') x =  '\n';
         else if (d == 'r') x =  '\r';
         else if (d == 't') x =  '\t';
-        *buf++ = x;
+        buf.concat(x);
       }
     } else {
-      *buf++ = c;
+      buf.concat(c);
     }
   }
-  *buf++ = '\0';
-  const String result = String(buf_mem);
-  return result;
+  return Value(std::move(buf));
 }
 
 class JSON {
  public:
-  JSON(const String &data) : data_(data) {
+  JSON(const Value &data) : data_(data) {
     ptr_ = skipWhitespaces(0);
     const char c = data_[ptr_];
-    const String s = data_.substring(ptr_, ptr_ + 4);
+    const Value s = data_.slice(ptr_, ptr_ + 4);
     if (c == '"') type = STRING;
     else if ((c >= '0' && c <= '9') || c == '.' || c == '-') type = NUMBER;
     else if (s == "null" || s == "true" || s == "fals") type = BOOLEAN;
@@ -101,49 +240,49 @@ class JSON {
     else type = ERROR;
   }
 
-  String value() const {
+  Value value() const {
     const size_t bgn = ptr_;
     const size_t end = skipObject(bgn);
     if (type == STRING) {
       return unescapeString(data_, bgn + 1, end - 1);
     } else if (type == NUMBER || type == BOOLEAN) {
-      return data_.substring(bgn, end);
+      return data_.slice(bgn, end);
     } else {
-      return "";
+      return Value();
     }
   }
 
-  String get(int key) const {
+  Value get(int key) const {
     size_t ptr = ptr_ + 1;
     while (true) {
       const size_t bgn = skipWhitespaces(ptr);
       const size_t end = skipObject(bgn);
-      if (end >= data_.length()) return "";
+      if (end >= data_.length()) return Value();
       if (key-- == 0) {
-        return data_.substring(bgn, end);
+        return data_.slice(bgn, end);
       }
       ptr = skipWhitespaces(end);
-      if (ptr >= data_.length() || data_[ptr] != ',') return "";
+      if (ptr >= data_.length() || data_[ptr] != ',') return Value();
       ptr++;
     }
   }
 
-  String get(const String &key) const {
+  Value get(const Value &key) const {
     size_t ptr = ptr_ + 1;
     while (true) {
       const size_t kbgn = skipWhitespaces(ptr);
-      if (kbgn >= data_.length() || data_[kbgn] != '"') return "";
+      if (kbgn >= data_.length() || data_[kbgn] != '"') return Value();
       const size_t kend = skipObject(kbgn);
       ptr = skipWhitespaces(kend);
-      if (ptr >= data_.length() || data_[ptr] != ':') return "";
+      if (ptr >= data_.length() || data_[ptr] != ':') return Value();
       const size_t vbgn = skipWhitespaces(ptr + 1);
       const size_t vend = skipObject(vbgn);
-      if (vend >= data_.length()) return "";
+      if (vend >= data_.length()) return Value();
       if (unescapeString(data_, kbgn + 1, kend - 1) == key) {
-        return data_.substring(vbgn, vend);
+        return data_.slice(vbgn, vend);
       }
       ptr = skipWhitespaces(vend);
-      if (ptr >= data_.length() || data_[ptr] != ',') return "";
+      if (ptr >= data_.length() || data_[ptr] != ',') return Value();
       ptr++;
     }
   }
@@ -211,13 +350,14 @@ class JSON {
     return ptr;
   }
 
-  const String &data_;
+  const Value &data_;
   size_t ptr_;
 };
 
 }
 
-Script::Script() : sleep_time_(24UL * 60 * 60 * 1000 * 1000), text_{0}, attr_{0}, func_size_(0) {
+Script::Script() : sleep_time_(24UL * 60 * 60 * 1000 * 1000), text_{0}, attr_{0}, func_size_(0), depth_(0), token_count_(0), profiling_(false), ops_prof_{}, funcs_prof_{}, funcs_active_{}, run_time_(0), profiled_time_(0), max_stack_(0), max_depth_(0) {
+  static_assert(sizeof(OPS) / sizeof(OPS[0]) == OPS_SIZE_, "Profiler table size mismatch.");
 }
 
 Script::~Script() {
@@ -229,10 +369,21 @@ void Script::initialize(const struct tm &time, float battery) {
 }
 
 void Script::run(const String &buf) {
+  if (depth_ >= MAX_DEPTH_) return;  // Runaway recursion would overflow the stack.
+#ifdef ARDUINO
+  uint8_t here;
+  if (&here - pxTaskGetStackStart(nullptr) < MIN_STACK_) return;  // Also bounds the frames larger than estimated.
+#endif
+  depth_++;
+  if (depth_ > max_depth_) max_depth_ = depth_;
+  const uint32_t run_bgn = (profiling_ && depth_ == 1) ? getMicros() : 0;
   size_t ptr = 0;
   while (true) {
     const String token = getNextToken(buf, &ptr);
-    if (token == "") break;
+    if (token == "" || token_count_ >= MAX_TOKENS_) break;  // A runaway script is stopped.
+    token_count_++;
+    const uint32_t token_bgn = profiling_ ? getMicros() : 0;
+    const uint32_t profiled_bgn = profiled_time_;
 
     if (token[0] == '#') {  // Comment.
       // NOP
@@ -241,10 +392,11 @@ void Script::run(const String &buf) {
     } else if ((token[0] >= '0' && token[0] <= '9') || token[0] == '-') {  // Number literal.
       stack_.push(token);
     } else if (token == "{" && stack_.size() >= 1) {
-      const String name = stack_.pop();
-      funcs_[func_size_].name = name;
-      String &code = funcs_[func_size_].code;
-      if (func_size_ < FUNCTIONS_SIZE_) func_size_++;
+      const String name = stack_.pop().str();
+      const int n = (func_size_ < FUNCTIONS_SIZE_) ? func_size_++ : FUNCTIONS_SIZE_ - 1;  // The last one is replaced when full.
+      funcs_[n].name = name;
+      String &code = funcs_[n].code;
+      code = "";
       String t;
       while ((t = getNextToken(buf, &ptr)) != "" && t != "}") {
         code.concat(t);
@@ -258,14 +410,14 @@ void Script::run(const String &buf) {
       }
      if (cond) run(code0); else if (code1.length()) run(code1);
     } else if (token == "dup" && stack_.size() >= 1) {
-      const String x = stack_.pop();
+      const Value x = stack_.pop();
       stack_.push(x);
       stack_.push(x);
     } else if (token == "drop" && stack_.size() >= 1) {
       stack_.pop();
     } else if (token == "swap" && stack_.size() >= 2) {
-      const String y = stack_.pop();
-      const String x = stack_.pop();
+      const Value y = stack_.pop();
+      const Value x = stack_.pop();
       stack_.push(y);
       stack_.push(x);
     } else if (token == "read" && stack_.size() >= 1) {
@@ -273,7 +425,7 @@ void Script::run(const String &buf) {
       stack_.push(stack_.get(n));
     } else if (token == "write" && stack_.size() >= 2) {
       const int n = stack_.pop().toInt();
-      const String v = stack_.pop();
+      const Value v = stack_.pop();
       stack_.put(n, v);
     } else if (token == "add" && stack_.size() >= 2) {
       const int y = stack_.pop().toInt();
@@ -290,18 +442,18 @@ void Script::run(const String &buf) {
     } else if (token == "div" && stack_.size() >= 2) {
       const int y = stack_.pop().toInt();
       const int x = stack_.pop().toInt();
-      stack_.push(String(x / y));
+      stack_.push(String((y != 0) ? x / y : 0));
     } else if (token == "mod" && stack_.size() >= 2) {
       const int y = stack_.pop().toInt();
       const int x = stack_.pop().toInt();
-      stack_.push(String(x % y));
+      stack_.push(String((y != 0) ? x % y : 0));
     } else if (token == "and" && stack_.size() >= 2) {
-      const String y = stack_.pop();
-      const String x = stack_.pop();
-      stack_.push(String((x != "0" && y != "0") ? "1" : "0"));
+      const Value y = stack_.pop();
+      const Value x = stack_.pop();
+      stack_.push((x != "0" && y != "0") ? "1" : "0");
     } else if (token == "or" && stack_.size() >= 2) {
-      const String y = stack_.pop();
-      const String x = stack_.pop();
+      const Value y = stack_.pop();
+      const Value x = stack_.pop();
       stack_.push((x != "0" || y != "0") ? "1" : "0");
     } else if (token == "lt" && stack_.size() >= 2) {
       const int y = stack_.pop().toInt();
@@ -328,34 +480,33 @@ void Script::run(const String &buf) {
       const int x = stack_.pop().toInt();
       stack_.push((x != y) ? "1" : "0");
     } else if (token == "length" && stack_.size() >= 1) {
-      const String x = stack_.pop();
-      stack_.push(String(x.length()));
+      const Value x = stack_.pop();
+      stack_.push(String((int)x.length()));
     } else if (token == "concat" && stack_.size() >= 2) {
-      const String y = stack_.pop();
-      const String x = stack_.pop();
+      const Value y = stack_.pop();
+      const Value x = stack_.pop();
       stack_.push(x + y);
     } else if (token == "substr" && stack_.size() >= 3) {
       const int length = stack_.pop().toInt();
       const int start = stack_.pop().toInt();
-      const String str = stack_.pop();
-      stack_.push(str.substring(start, start +length));
+      const Value str = stack_.pop();
+      stack_.push(str.slice(start, start + length));
     } else if (token == "find" && stack_.size() >= 2) {
-      const String sub = stack_.pop();
-      const String str = stack_.pop();
+      const Value sub = stack_.pop();
+      const Value str = stack_.pop();
       stack_.push(String(str.indexOf(sub)));
     } else if (token == "rfind" && stack_.size() >= 2) {
-      const String sub = stack_.pop();
-      const String str = stack_.pop();
+      const Value sub = stack_.pop();
+      const Value str = stack_.pop();
       stack_.push(String(str.lastIndexOf(sub)));
     } else if (token == "replace" && stack_.size() >= 3) {
-      const String after = stack_.pop();
-      const String before = stack_.pop();
-      String str = stack_.pop();
-      str.replace(before, after);
-      stack_.push(str);
+      const Value after = stack_.pop();
+      const Value before = stack_.pop();
+      const Value str = stack_.pop();
+      stack_.push(str.replace(before, after));
     } else if (token == "format" && stack_.size() >= 4) {
-      const int dec = stack_.pop().toInt();
-      const int len = stack_.pop().toInt();
+      const int dec = std::min(std::max((int)stack_.pop().toInt(), 0), 9);
+      const int len = std::min(std::max((int)stack_.pop().toInt(), 0), 255);
       const int sign = stack_.pop().toInt();
       const float num = stack_.pop().toFloat();
       String result;
@@ -369,20 +520,20 @@ void Script::run(const String &buf) {
       result = result.substring(result.length() - len);
       stack_.push(result);
     } else if (token == "extract" && stack_.size() >= 3) {
-      const String suffix = stack_.pop();
-      const String prefix = stack_.pop();
-      const String str = stack_.pop();
+      const Value suffix = stack_.pop();
+      const Value prefix = stack_.pop();
+      const Value str = stack_.pop();
       int bgn = str.indexOf(prefix);
       if (bgn < 0) bgn = str.length(); else bgn += prefix.length();
       const int end = str.indexOf(suffix, bgn);
       if (end < 0) {
-        stack_.push("");
+        stack_.push(Value());
       } else {
-        stack_.push(str.substring(bgn, end));
+        stack_.push(str.slice(bgn, end));
       }
     } else if (token == "lookup" && stack_.size() >= 2) {
-      const String key = stack_.pop();
-      const String str = stack_.pop();
+      const Value key = stack_.pop();
+      const Value str = stack_.pop();
       const JSON json(str);
       if (json.type == JSON::OBJECT) {
         stack_.push(json.get(key));
@@ -395,29 +546,32 @@ void Script::run(const String &buf) {
       const int y = stack_.pop().toInt();
       const int x = stack_.pop().toInt();
       const int attr = stack_.pop().toInt();
-      const String str = stack_.pop();
-      for (size_t i = 0; i < str.length(); i++) {
+      const Value str = stack_.pop();
+      for (size_t i = 0; i < str.length() && y >= 0 && y < HEIGHT && x >= 0; i++) {
         if (x + i >= WIDTH * 2) break;
         text_[WIDTH * 2 * y + x + i] = str[i];
         attr_[WIDTH * 2 * y + x + i] = attr;
       }
     } else if (token == "wget" && stack_.size() >= 1) {
-      const String url = stack_.pop();
+      const Value url = stack_.pop();
 #ifdef ARDUINO
       String page;
-      getHTTP(url, &page);
-      stack_.push(page);
+      const bool upload = (upload_server_.length() > 0 && url.str().startsWith(upload_server_));
+      getHTTP(url.str(), &page, upload ? upload_ : String());
+      if (upload) upload_ = "";
+      stack_.push(Value(std::move(page)));
 #else
-      const uint32_t hash = fnv1Hash((uint8_t *)url.string().data(), url.length());
+      const uint32_t hash = fnv1Hash((const uint8_t *)url.data(), url.length());
       const std::string file = "cache_" + std::to_string(hash) + ".dat";
       std::string buf;
       std::ifstream ifs(file);
+      if (!ifs && fetch_ && fetchHTTP(url.str().string(), file)) ifs.open(file);
       if (ifs) {
         std::getline(ifs, buf, '\0');
       } else {
-        std::cerr << "Cache not found: '" << file << "' for '" << url.string() << "'\n";
+        std::cerr << "Cache not found: '" << file << "' for '" << url.str().string() << "'\n";
       }
-      stack_.push(String(buf));
+      stack_.push(Value(String(std::move(buf))));
 #endif
     } else if (token == "date") {
       stack_.push(String(time_.tm_wday));
@@ -437,7 +591,9 @@ void Script::run(const String &buf) {
     } else {
       for (int i = func_size_ - 1; i >= 0; i--) {
         if (token == funcs_[i].name) {
+          funcs_active_[i]++;
           run(funcs_[i].code);
+          funcs_active_[i]--;
           break;
         }
 #ifndef ARDUINO
@@ -445,7 +601,57 @@ void Script::run(const String &buf) {
 #endif
       }
     }
+    if (profiling_) profile(token, getMicros() - token_bgn, profiled_time_ - profiled_bgn);
+  }
+  if (profiling_ && depth_ == 1) run_time_ += getMicros() - run_bgn;
+  depth_--;
+}
+
+void Script::enableProfiler() {
+  profiling_ = true;
+}
+
+#ifndef ARDUINO
+void Script::enableFetch() {
+  fetch_ = true;
+}
+#endif
+
+void Script::setProfileUpload(const String &summary, const String &server) {
+  upload_ = summary;
+  upload_server_ = server;
+}
+
+// Returns the report with a line for each operation and function which was executed.
+String Script::getProfile() {
+  String report = getProfileSummary();
+  report.concat("\n");
+  for (int i = 0; i < OPS_SIZE_; i++) {
+    if (ops_prof_[i].count == 0) continue;
+    report.concat("op " + String(OPS[i]) + " " + String((int)ops_prof_[i].count) + " " + String((int)ops_prof_[i].time) + "\n");
+  }
+  for (int i = 0; i < func_size_; i++) {
+    if (funcs_prof_[i].count == 0) continue;
+    report.concat("func " + funcs_[i].name + " " + String((int)funcs_prof_[i].count) + " " + String((int)funcs_prof_[i].time) + "\n");
   }
+  return report;
+}
+
+// Returns a single line of the totals and the most expensive function.
+String Script::getProfileSummary() {
+  const uint32_t wget = ops_prof_[OP_WGET].time;
+  String summary = "total=" + String((int)run_time_) + " wget=" + String((int)wget) + " compute=" + String((int)(run_time_ - wget));
+  summary.concat(" tokens=" + String((int)token_count_) + " stack=" + String(max_stack_) + " depth=" + String(max_depth_));
+  int top = -1;
+  for (int i = 0; i < func_size_; i++) {
+    if (funcs_prof_[i].count > 0 && (top < 0 || funcs_prof_[i].time > funcs_prof_[top].time)) top = i;
+  }
+  if (top >= 0) summary.concat(" top=" + funcs_[top].name + ":" + String((int)funcs_prof_[top].time));
+  return summary;
+}
+
+uint32_t Script::getTokenCount() {
+  return token_count_;
 }
 
 uint64_t Script::getSleepTime() {
@@ -458,7 +664,7 @@ void Script::getScreen(const uint8_t **text, const uint8_t **attr) {
 #ifndef ARDUINO
   std::cerr << "----- Stack dump begin -----\n";
   while (stack_.size()) {
-    std::cerr << stack_.pop().string() << "\n\n";
+    std::cerr << stack_.pop().str().string() << "\n\n";
   }
   std::cerr << "----- Stack dump end -----\n";
 #endif
@@ -478,6 +684,32 @@ String Script::getNextToken(const String &buf, size_t *ptr) {
   return (token.length() > 0) ? token : getNextToken(buf, ptr);
 }
 
+// Accounts a token which took the time, of which nested is the time of the tokens executed in its nested runs.
+void Script::profile(const String &token, uint32_t time, uint32_t nested) {
+  if (stack_.size() > max_stack_) max_stack_ = stack_.size();
+  profiled_time_ += time - nested;
+  if (token[0] == '#') return;
+  if (token[0] == '"' || (token[0] >= '0' && token[0] <= '9') || token[0] == '-') {
+    ops_prof_[OP_LITERAL].count++;
+    ops_prof_[OP_LITERAL].time += time - nested;
+    return;
+  }
+  for (int i = 1; i < OPS_SIZE_; i++) {
+    if (token == OPS[i]) {
+      ops_prof_[i].count++;
+      ops_prof_[i].time += time - nested;
+      return;
+    }
+  }
+  for (int i = func_size_ - 1; i >= 0; i--) {
+    if (token == funcs_[i].name) {
+      funcs_prof_[i].count++;
+      if (funcs_active_[i] == 0) funcs_prof_[i].time += time;  // Only the outermost call of a recursion.
+      return;
+    }
+  }
+}
+
 bool Script::getClause(const String &buf, size_t *ptr, String *code) {
   String token;
   int nest = 0;
@@ -6,29 +6,98 @@
 #ifdef ARDUINO
 #include <Arduino.h>
 #else
+#include <chrono>
 #include <fstream>
 #include <iostream>
-#include "test/String.h"
+#include "pc_version/String.h"
 #endif
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+// String value which refers to a part of a shared string, so that copying and slicing do not copy the characters.
+// Short values are stored inline instead.
+class Value {
+ public:
+  Value() : bgn_(0), len_(0), buf_{0} {
+  }
+
+  Value(const char *s) : Value(s, strlen(s)) {
+  }
+
+  Value(const char *s, size_t n);
+  Value(const String &s) : Value(s.c_str(), s.length()) {
+  }
+
+  Value(String &&s);
+  Value slice(size_t bgn, size_t end) const;
+  int indexOf(const Value &sub, size_t from = 0) const;
+  int lastIndexOf(const Value &sub) const;
+  Value replace(const Value &before, const Value &after) const;
+  long toInt() const;
+  float toFloat() const;
+  String str() const;
+
+  const char *data() const {
+    return str_ ? str_->c_str() + bgn_ : buf_;
+  }
+
+  size_t length() const {
+    return len_;
+  }
+
+  char operator[](size_t n) const {
+    return (n < len_) ? data()[n] : '\0';
+  }
+
+  bool operator==(const Value &x) const {
+    return (len_ == x.len_ && memcmp(data(), x.data(), len_) == 0);
+  }
+
+  bool operator!=(const Value &x) const {
+    return !(*this == x);
+  }
+
+  bool operator==(const char *x) const {
+    return (strlen(x) == len_ && memcmp(data(), x, len_) == 0);
+  }
+
+  bool operator!=(const char *x) const {
+    return !(*this == x);
+  }
+
+  Value operator+(const Value &x) const;
+
+ private:
+  constexpr static const size_t INLINE_SIZE_ = 15;
+  std::shared_ptr<const String> str_;
+  size_t bgn_;
+  size_t len_;
+  char buf_[INLINE_SIZE_ + 1];
+};
 
 class Stack {
  public:
   Stack() : size_(0) {
   }
 
-  void push(const String &v) {
+  void push(const Value &v) {
     if (size_ < CAPACITY_) stack_[size_++] = v;
   }
 
-  String pop() {
-    return (size_ > 0) ? stack_[--size_] : String("");
+  Value pop() {
+    if (size_ == 0) return Value();
+    Value v = std::move(stack_[--size_]);
+    stack_[size_] = Value();  // Release the slot so that it does not keep a page alive.
+    return v;
   }
 
-  const String &get(size_t n) const {
+  const Value &get(size_t n) const {
     return stack_[(n < size_) ? size_ - 1 - n : 0];
   }
 
-  void put(size_t n, const String &v) {
+  void put(size_t n, const Value &v) {
     if (n < size_) stack_[size_ - 1 - n] = v;
   }
 
@@ -39,7 +108,7 @@ class Stack {
 private:
   constexpr static const int CAPACITY_ = 64;
   size_t size_;
-  String stack_[CAPACITY_];
+  Value stack_[CAPACITY_];
 };
 
 class Script {
@@ -49,7 +118,15 @@ class Script {
   void initialize(const struct tm &time, float battery);
   void run(const String &buf);
   uint64_t getSleepTime();
+  uint32_t getTokenCount();
+  void enableProfiler();
+  void setProfileUpload(const String &summary, const String &server);
+  String getProfile();
+  String getProfileSummary();
   void getScreen(const uint8_t **text, const uint8_t **attr);
+#ifndef ARDUINO
+  void enableFetch();
+#endif
 
   constexpr static const int WIDTH = 16;
   constexpr static const int HEIGHT = 12;
@@ -58,6 +135,7 @@ class Script {
  private:
   String getNextToken(const String &buf, size_t *ptr);
   bool getClause(const String &buf, size_t *ptr, String *code);
+  void profile(const String &token, uint32_t time, uint32_t nested);
 
   struct tm time_;
   float battery_;
@@ -71,6 +149,36 @@ class Script {
     String code;
   } funcs_[FUNCTIONS_SIZE_];
   int func_size_;
+#ifdef ARDUINO
+  // A level of run() takes about 1 KB of stack on x86-64 (-Os) and somewhat less on the ESP32, whose loop task has 16 KB.
+  constexpr static const int MAX_DEPTH_ = 16;
+  constexpr static const int MIN_STACK_ = 4096;  // Stack kept for the operators of the deepest level, including HTTP and TLS.
+#else
+  constexpr static const int MAX_DEPTH_ = 128;
+#endif
+  int depth_;
+  constexpr static const uint32_t MAX_TOKENS_ = 100000;
+  uint32_t token_count_;
+
+  // Profiler.
+  constexpr static const int OPS_SIZE_ = 35;
+  struct Counter {
+    uint32_t count;
+    uint32_t time;  // Accumulated microseconds.
+  };
+  bool profiling_;
+  Counter ops_prof_[OPS_SIZE_];  // Excluding the time of nested runs.
+  Counter funcs_prof_[FUNCTIONS_SIZE_];  // Including the time of nested runs, but not twice for recursive calls.
+  uint8_t funcs_active_[FUNCTIONS_SIZE_];
+  uint32_t run_time_;
+  uint32_t profiled_time_;
+  int max_stack_;
+  int max_depth_;
+  String upload_;  // Profile summary of the previous run sent with the first HTTP request to upload_server_.
+  String upload_server_;  // URL prefix of the user's own server. Other hosts never receive the summary.
+#ifndef ARDUINO
+  bool fetch_ = false;  // Pages missing in the cache are fetched with curl.
+#endif
 };
 
 #endif
@@ -0,0 +1,300 @@
+// TLS client which resumes sessions cached in RTC memory across deep sleep
+
+#ifndef TLSCLIENT_H_
+#define TLSCLIENT_H_
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <WiFiClient.h>
+#else
+#include "pc_version/WiFiClient.h"
+#endif
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/version.h>
+#include <mbedtls/x509_crt.h>
+
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+#define TLSCLIENT_STATE(ssl) ((ssl).MBEDTLS_PRIVATE(state))
+#else
+#define TLSCLIENT_STATE(ssl) ((ssl).state)
+#endif
+
+// Sessions are serialized into RTC memory by mbedtls_ssl_session_save(), which older cores with mbedtls before 2.21 do not have.
+// There no session is stored, and every handshake is a full one.
+#if MBEDTLS_VERSION_NUMBER >= 0x02150000
+#define TLSCLIENT_SESSION_CACHE 1
+#else
+#define TLSCLIENT_SESSION_CACHE 0
+#endif
+
+class TLSClient : public WiFiClient {
+public:
+  static constexpr const int SESSION_SIZE = 2048;  // Large enough for a session keeping the peer certificate.
+  static constexpr const uint32_t HANDSHAKE_TIMEOUT = 20000;
+
+  TLSClient() : ca_cert_(nullptr), handshake_timeout_(HANDSHAKE_TIMEOUT), ready_(false), active_(false), peek_(-1), handshake_time_(0), resumed_(false) {
+  }
+
+  ~TLSClient() {
+    stop();
+  }
+
+  // The certificate is verified only if a CA certificate is given, which is the same as HTTPClient without one.
+  void setCACert(const char *pem) {
+    ca_cert_ = pem;
+  }
+
+  void setHandshakeTimeout(uint32_t timeout) {
+    handshake_timeout_ = timeout;
+  }
+
+  int connect(IPAddress ip, uint16_t port) {
+    return connect(ip.toString().c_str(), port, HANDSHAKE_TIMEOUT);
+  }
+
+  int connect(IPAddress ip, uint16_t port, int32_t timeout) {
+    return connect(ip.toString().c_str(), port, timeout);
+  }
+
+  int connect(const char *host, uint16_t port) {
+    return connect(host, port, HANDSHAKE_TIMEOUT);
+  }
+
+  int connect(const char *host, uint16_t port, int32_t timeout) {
+    stop();
+    if (!WiFiClient::connect(host, port, timeout)) return 0;
+    const uint32_t bgn = millis();
+    if (!setup(host)) {
+      stop();
+      return 0;
+    }
+#if TLSCLIENT_SESSION_CACHE
+    Entry *entry = find(host);
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    if (entry && mbedtls_ssl_session_load(&session, entry->data, entry->size) == 0) mbedtls_ssl_set_session(&ssl_, &session);
+    mbedtls_ssl_session_free(&session);
+#endif
+
+    // Step the handshake to see whether the server sent its certificate, which is skipped when the session is resumed.
+    bool full = false;
+    while (TLSCLIENT_STATE(ssl_) != MBEDTLS_SSL_HANDSHAKE_OVER) {
+      if (TLSCLIENT_STATE(ssl_) == MBEDTLS_SSL_SERVER_CERTIFICATE) full = true;
+      const int ret = mbedtls_ssl_handshake_step(&ssl_);
+      if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        if (millis() - bgn >= handshake_timeout_) break;
+        delay(1);
+      } else if (ret != 0) {
+        break;
+      }
+    }
+    if (TLSCLIENT_STATE(ssl_) != MBEDTLS_SSL_HANDSHAKE_OVER) {
+#if TLSCLIENT_SESSION_CACHE
+      if (entry) entry->host[0] = '\0';  // The cached session may be the cause.
+#endif
+      stop();
+      return 0;
+    }
+    active_ = true;
+    handshake_time_ = millis() - bgn;
+    resumed_ = !full;
+    stats()[resumed_ ? 1 : 0] = handshake_time_;
+#if TLSCLIENT_SESSION_CACHE
+    save(host);
+#endif
+    return 1;
+  }
+
+  size_t write(uint8_t c) {
+    return write(&c, 1);
+  }
+
+  size_t write(const uint8_t *buf, size_t size) {
+    if (!active_) return 0;
+    size_t len = 0;
+    while (len < size) {
+      const int ret = mbedtls_ssl_write(&ssl_, buf + len, size - len);
+      if (ret > 0) {
+        len += ret;
+      } else if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+        stop();
+        break;
+      }
+    }
+    return len;
+  }
+
+  int available() {
+    if (!active_) return 0;
+    int n = mbedtls_ssl_get_bytes_avail(&ssl_);
+    if (n == 0) {
+      const int ret = mbedtls_ssl_read(&ssl_, nullptr, 0);  // Decrypts the next record if it has arrived.
+      n = mbedtls_ssl_get_bytes_avail(&ssl_);
+      if (n == 0 && ret != 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) active_ = false;
+    }
+    return n + ((peek_ >= 0) ? 1 : 0);
+  }
+
+  int read() {
+    uint8_t c;
+    return (read(&c, 1) == 1) ? c : -1;
+  }
+
+  int read(uint8_t *buf, size_t size) {
+    if (size == 0) return 0;
+    int len = 0;
+    if (peek_ >= 0) {
+      *buf++ = peek_;
+      peek_ = -1;
+      size--;
+      len++;
+    }
+    if (size > 0 && available() > 0) {
+      const int ret = mbedtls_ssl_read(&ssl_, buf, size);
+      if (ret > 0) len += ret;
+    }
+    return (len > 0) ? len : -1;
+  }
+
+  int peek() {
+    if (peek_ < 0) peek_ = read();
+    return peek_;
+  }
+
+  void flush() {
+  }
+
+  uint8_t connected() {
+    return (active_ && (available() > 0 || WiFiClient::connected()));
+  }
+
+  operator bool() {
+    return connected();
+  }
+
+  void stop() {
+    if (active_) mbedtls_ssl_close_notify(&ssl_);
+    if (ready_) {
+      mbedtls_ssl_free(&ssl_);
+      mbedtls_ssl_config_free(&conf_);
+      mbedtls_ctr_drbg_free(&drbg_);
+      mbedtls_entropy_free(&entropy_);
+      mbedtls_x509_crt_free(&ca_);
+    }
+    active_ = false;
+    ready_ = false;
+    peek_ = -1;
+    WiFiClient::stop();
+  }
+
+  uint32_t handshakeTime() const {
+    return handshake_time_;
+  }
+
+  bool resumed() const {
+    return resumed_;
+  }
+
+  // Returns the time of the last full handshake and of the last resumed one kept across deep sleep (ms).
+  static uint32_t lastHandshakeTime(bool resumed) {
+    return stats()[resumed ? 1 : 0];
+  }
+
+private:
+  static uint32_t *stats() {
+    static RTC_DATA_ATTR uint32_t times[2];
+    return times;
+  }
+
+#if TLSCLIENT_SESSION_CACHE
+  // A single session is cached, since the firmware talks to its own data server. It takes 2 KB of the 8 KB RTC slow memory.
+  struct Entry {
+    char host[48];
+    uint16_t size;
+    uint8_t data[SESSION_SIZE];
+  };
+
+  static Entry &cache() {
+    static RTC_DATA_ATTR Entry entry;
+    return entry;
+  }
+
+  static Entry *find(const char *host) {
+    Entry &entry = cache();
+    return (entry.host[0] != '\0' && strncmp(entry.host, host, sizeof(entry.host)) == 0) ? &entry : nullptr;
+  }
+
+  // Keeps the session of the current connection, replacing the session of another host.
+  void save(const char *host) {
+    if (strlen(host) >= sizeof(Entry::host)) return;
+    Entry &entry = cache();
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    size_t size = 0;
+    if (mbedtls_ssl_get_session(&ssl_, &session) == 0 && mbedtls_ssl_session_save(&session, entry.data, SESSION_SIZE, &size) == 0) {
+      strcpy(entry.host, host);
+      entry.size = size;
+    } else {
+      entry.host[0] = '\0';
+    }
+    mbedtls_ssl_session_free(&session);
+  }
+#endif
+
+  bool setup(const char *host) {
+    mbedtls_ssl_init(&ssl_);
+    mbedtls_ssl_config_init(&conf_);
+    mbedtls_ctr_drbg_init(&drbg_);
+    mbedtls_entropy_init(&entropy_);
+    mbedtls_x509_crt_init(&ca_);
+    ready_ = true;
+    if (mbedtls_ctr_drbg_seed(&drbg_, mbedtls_entropy_func, &entropy_, (const unsigned char *)"e_info", 6) != 0) return false;
+    if (mbedtls_ssl_config_defaults(&conf_, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT) != 0) return false;
+    if (ca_cert_) {
+      if (mbedtls_x509_crt_parse(&ca_, (const unsigned char *)ca_cert_, strlen(ca_cert_) + 1) != 0) return false;
+      mbedtls_ssl_conf_ca_chain(&conf_, &ca_, nullptr);
+      mbedtls_ssl_conf_authmode(&conf_, MBEDTLS_SSL_VERIFY_REQUIRED);
+    } else {
+      mbedtls_ssl_conf_authmode(&conf_, MBEDTLS_SSL_VERIFY_NONE);
+    }
+    mbedtls_ssl_conf_rng(&conf_, mbedtls_ctr_drbg_random, &drbg_);
+#ifdef MBEDTLS_SSL_SESSION_TICKETS
+    mbedtls_ssl_conf_session_tickets(&conf_, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+    if (mbedtls_ssl_setup(&ssl_, &conf_) != 0) return false;
+    if (mbedtls_ssl_set_hostname(&ssl_, host) != 0) return false;
+    mbedtls_ssl_set_bio(&ssl_, this, send, recv, nullptr);
+    return true;
+  }
+
+  static int send(void *ctx, const unsigned char *buf, size_t len) {
+    TLSClient *client = (TLSClient *)ctx;
+    const int n = client->WiFiClient::write(buf, len);
+    if (n > 0) return n;
+    return client->WiFiClient::connected() ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_SEND_FAILED;
+  }
+
+  static int recv(void *ctx, unsigned char *buf, size_t len) {
+    TLSClient *client = (TLSClient *)ctx;
+    if (client->WiFiClient::available() <= 0) return client->WiFiClient::connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+    const int n = client->WiFiClient::read(buf, len);
+    return (n > 0) ? n : MBEDTLS_ERR_SSL_WANT_READ;
+  }
+
+  const char *ca_cert_;
+  uint32_t handshake_timeout_;
+  bool ready_;  // The contexts are initialized.
+  bool active_;  // The handshake is over.
+  int peek_;
+  uint32_t handshake_time_;
+  bool resumed_;
+  mbedtls_ssl_context ssl_;
+  mbedtls_ssl_config conf_;
+  mbedtls_ctr_drbg_context drbg_;
+  mbedtls_entropy_context entropy_;
+  mbedtls_x509_crt ca_;
+};
+
+#endif
@@ -5,9 +5,13 @@
 #include <WiFi.h>
 #include <soc/rtc_cntl_reg.h>
 #include "EPDClass.h"
+#include "Render.h"
 #include "Script.h"
 
 extern "C" int rom_phy_get_vdd33();
+#ifdef SET_LOOP_TASK_STACK_SIZE
+SET_LOOP_TASK_STACK_SIZE(16 * 1024);  // Nested functions of the script.
+#endif
 
 constexpr static int SHUTDOWN_VOLTAGE = 2.7;
 constexpr static int BUFFER_SIZE = 32 * 1024;
@@ -23,9 +27,10 @@ static Preferences preferences;
 static EPDClass epd(BUSY_PIN, RST_PIN, DC_PIN, CS_PIN);
 static Script script;
 static uint8_t buffer[BUFFER_SIZE];
-static uint8_t screen_blk[5808];
-static uint8_t screen_red[5808];
+static uint8_t screen_blk[Render::FRAME_SIZE];
+static uint8_t screen_red[Render::FRAME_SIZE];
 static float voltage;
+RTC_DATA_ATTR static char profile_summary[160];  // Kept during the deep sleep to be uploaded on the next wake.
 
 void setup() {
   WRITE_PERI_REG(RTC_CNTL_BROWN_OUT_REG, 0);  // Disable brown-out detection.
@@ -144,6 +149,20 @@ void config() {
         } else {
           message = "Failed to update PASS.";
         }
+      } else if (line.startsWith("POST /prof.cgi ")) {
+        if (size > 0) {
+          buffer[size] = '\0';
+          preferences.putString("PROF", (char *)buffer);
+          Serial.println("PROF: " + String((char *)buffer));
+          message = "Succeeded to update PROF.";
+        } else {
+          message = "Failed to update PROF.";
+        }
+      } else if (line.startsWith("POST /purl.cgi ")) {
+        buffer[(size > 0) ? size : 0] = '\0';  // Empty to stop the upload.
+        preferences.putString("PURL", (char *)buffer);
+        Serial.println("PURL: " + String((char *)buffer));
+        message = "Succeeded to update PURL.";
       } else if (line.startsWith("POST /font.cgi ")) {
         if (size == 11264) {
           preferences.putBytes("FONT", buffer, size);
@@ -175,6 +194,8 @@ void config() {
       client.println("<h1>E-Info</h1>");
       client.println("<form action=\"ssid.cgi\" method=\"post\" enctype=\"multipart/form-data\">SSID: <input type=\"text\" name=\"data\" size=\"10\"> <input type=\"submit\"></form>");
       client.println("<form action=\"pass.cgi\" method=\"post\" enctype=\"multipart/form-data\">PASS: <input type=\"text\" name=\"data\" size=\"10\"> <input type=\"submit\"></form>");
+      client.println("<form action=\"prof.cgi\" method=\"post\" enctype=\"multipart/form-data\">PROF: <input type=\"text\" name=\"data\" size=\"10\"> <input type=\"submit\"></form>");
+      client.println("<form action=\"purl.cgi\" method=\"post\" enctype=\"multipart/form-data\">PURL: <input type=\"text\" name=\"data\" size=\"40\"> <input type=\"submit\"></form>");
       client.println("<form action=\"font.cgi\" method=\"post\" enctype=\"multipart/form-data\">FONT: <input type=\"file\" name=\"data\"> <input type=\"submit\"></form>");
       client.println("<form action=\"code.cgi\" method=\"post\" enctype=\"multipart/form-data\">CODE: <input type=\"file\" name=\"data\"> <input type=\"submit\"></form>");
       client.println("<p>" + message + "</p>");
@@ -242,8 +263,19 @@ void run() {
   // Run the script.
   Serial.println("Running the code: " + String(preferences.getBytesLength("CODE") - 1));
   script.initialize(time, voltage);
+  const bool profiling = (preferences.getString("PROF") == "1");
+  if (profiling) {
+    script.enableProfiler();
+    script.setProfileUpload(profile_summary, preferences.getString("PURL"));
+  }
   preferences.getBytes("CODE", buffer, BUFFER_SIZE);
   script.run((char *)buffer);
+  if (profiling) {
+    Serial.print("Profile:\n" + script.getProfile());
+    strncpy(profile_summary, script.getProfileSummary().c_str(), sizeof(profile_summary) - 1);
+  } else {
+    profile_summary[0] = '\0';
+  }
 
   // Disable WiFi.
   WiFi.disconnect(true);
@@ -273,68 +305,6 @@ void run() {
 
 void drawScreen(const uint8_t *text, const uint8_t *attr, uint8_t *buf_blk, uint8_t *buf_red) {
   uint16_t *font = (uint16_t *)buffer; 
-  preferences.getBytes("FONT", font, 11264);
-  uint16_t *bmp_blk = (uint16_t *)(buffer + 11264);
-  uint16_t *bmp_red = (uint16_t *)(buffer + 11264 + 2 * Script::WIDTH);
-
-  for (int ty = 0; ty < Script::HEIGHT; ty++) {
-    for (int h = 0; h < Script::PIXELS; h++) {
-      int tx = 0;
-      // Copy the font bitmap for one line.
-      for (int w = 0; w < Script::WIDTH; w++) {
-        const uint8_t a = attr[2 * Script::WIDTH * ty + tx];
-        const uint8_t c = text[2 * Script::WIDTH * ty + tx++];
-        uint16_t f;
-        if (a & 0x04) {
-          const uint8_t cc = 0xd0 + ((c - 0x20) >> 1);
-          const uint8_t d = text[2 * Script::WIDTH * ty + tx++];
-          const uint8_t dd = 0xd0 + ((d - 0x20) >> 1);
-          if (c & 0x01) {
-            f = (font[Script::PIXELS * cc + h] << 6);
-          } else {
-            f = (font[Script::PIXELS * cc + h] & 0xf800);;
-          }
-          if (d & 0x01) {
-            f |= (font[Script::PIXELS * dd + h] & 0x03e0);
-          } else {
-            f |= (font[Script::PIXELS * dd + h] >> 6);;
-          }
-        } else {
-          f = font[Script::PIXELS * c + h];
-        }
-        if (a & 0x02) {
-          f = ~f;
-        }
-        if (a & 0x01) {
-          bmp_blk[w] = 0x00;
-          bmp_red[w] = (f & 0xffe0);
-        } else {
-          bmp_blk[w] = (f & 0xffe0);
-          bmp_red[w] = 0x00;
-        }
-      }
-
-      // Render the font to the screen buffer.
-      int ptr = (EPDClass::WIDTH / 8) * (Script::PIXELS * ty + h);
-      int size = 8;
-      uint8_t acc_blk = 0x00;
-      uint8_t acc_red = 0x00;
-      for (int w = 0; w < Script::WIDTH; w++) {
-        acc_blk |= (uint8_t)(bmp_blk[w] >> (16 - size));
-        acc_red |= (uint8_t)(bmp_red[w] >> (16 - size));
-        buf_blk[ptr] = acc_blk;
-        buf_red[ptr] = acc_red;
-        ptr++;
-        if (11 - size >= 8) {
-          buf_blk[ptr] = (uint8_t)((bmp_blk[w] >> (16 - size - 8)) & 0x00ff);
-          buf_red[ptr] = (uint8_t)((bmp_red[w] >> (16 - size - 8)) & 0x00ff);
-          ptr++;
-          size += 8;
-        }
-        acc_blk = (uint8_t)((bmp_blk[w] << size) >> 8);
-        acc_red = (uint8_t)((bmp_red[w] << size) >> 8);
-        size = 8 - (11 - size);
-      }
-    }
-  }
+  preferences.getBytes("FONT", font, Render::FONT_SIZE);
+  Render::draw(text, attr, font, buf_blk, buf_red);
 }
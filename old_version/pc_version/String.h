@@ -14,6 +14,9 @@ class String {
   String(const std::string &s) : str_(s) {
   }
 
+  String(std::string &&s) : str_(std::move(s)) {
+  }
+
   String(const char *s) : str_(s) {
   }
 
@@ -23,7 +26,7 @@ class String {
 
   String(float x, int dec) {
     char buf[100];
-    sprintf(buf, "%.*f", dec, x);
+    snprintf(buf, sizeof(buf), "%.*f", dec, x);
     str_ = std::string(buf);
   }
 
@@ -51,18 +54,40 @@ class String {
   }
 
   void replace(const String &x, const String &y) {
-    std::string result(str_);
+    if (x.str_.empty()) return;
+    std::string result;
+    result.reserve(str_.length());
+    size_t bgn = 0;
     size_t pos;
-    while ((pos = result.find(x.str_)) != std::string::npos) {
-      result.replace(pos, x.str_.length(), y.str_);
+    while ((pos = str_.find(x.str_, bgn)) != std::string::npos) {
+      result.append(str_, bgn, pos - bgn);
+      result.append(y.str_);
+      bgn = pos + x.str_.length();
     }
-    str_ = result;
+    result.append(str_, bgn, std::string::npos);
+    str_ = std::move(result);
   }
 
   void concat(const String &x) {
     str_ += x.str_;
   }
 
+  void concat(const char *x, size_t n) {
+    str_.append(x, n);
+  }
+
+  void concat(char x) {
+    str_ += x;
+  }
+
+  void reserve(size_t n) {
+    str_.reserve(n);
+  }
+
+  const char *c_str() const {
+    return str_.c_str();
+  }
+
   std::string string() const {
     return str_;
   }
@@ -91,4 +116,8 @@ class String {
   std::string str_;
 };
 
+inline String operator+(const char *x, const String &y) {
+  return String(x) + y;
+}
+
 #endif
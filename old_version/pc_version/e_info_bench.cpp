@@ -0,0 +1,140 @@
+// Benchmark for the script interpreter.
+// Runs each script against the cached pages in the current directory, and prints one JSON object per script.
+// Usage: e_info_bench [-n RUNS] SCRIPT...
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <time.h>
+#include "../Script.h"
+
+namespace {
+
+// Statistics of the instrumented allocator.
+size_t alloc_count = 0;
+size_t alloc_bytes = 0;
+size_t heap_size = 0;
+size_t heap_peak = 0;
+
+constexpr size_t HEADER_SIZE = alignof(std::max_align_t);  // Keeps the size of each block in front of it.
+
+void *allocate(size_t size) {
+  uint8_t *p = (uint8_t *)malloc(HEADER_SIZE + size);
+  if (!p) throw std::bad_alloc();
+  *(size_t *)p = size;
+  alloc_count++;
+  alloc_bytes += size;
+  heap_size += size;
+  if (heap_size > heap_peak) heap_peak = heap_size;
+  return p + HEADER_SIZE;
+}
+
+void deallocate(void *ptr) {
+  if (!ptr) return;
+  uint8_t *p = (uint8_t *)ptr - HEADER_SIZE;
+  heap_size -= *(size_t *)p;
+  free(p);
+}
+
+struct Result {
+  double wall_us;  // Average wall time per run.
+  uint32_t tokens;
+  size_t allocs;
+  size_t bytes;
+  size_t peak;  // Peak heap usage above the usage before the run.
+};
+
+Result measure(const std::string &code, const struct tm &time, int runs) {
+  Result result = {0.0, 0, 0, 0, 0};
+  const String buf(code);
+  for (int i = 0; i < runs; i++) {
+    const size_t count = alloc_count;
+    const size_t bytes = alloc_bytes;
+    const size_t base = heap_size;
+    heap_peak = heap_size;
+    const auto bgn = std::chrono::steady_clock::now();
+    {
+      Script script;
+      script.initialize(time, 3.14);
+      script.run(buf);
+      result.tokens = script.getTokenCount();
+    }
+    const auto end = std::chrono::steady_clock::now();
+    result.wall_us += std::chrono::duration<double, std::micro>(end - bgn).count() / runs;
+    result.allocs = alloc_count - count;
+    result.bytes = alloc_bytes - bytes;
+    result.peak = heap_peak - base;
+  }
+  return result;
+}
+
+}
+
+void *operator new(size_t size) {
+  return allocate(size);
+}
+
+void *operator new[](size_t size) {
+  return allocate(size);
+}
+
+void operator delete(void *ptr) noexcept {
+  deallocate(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+  deallocate(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+  deallocate(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+  deallocate(ptr);
+}
+
+int main(int argc, char *argv[]) {
+  int runs = 20;
+  int arg = 1;
+  if (arg + 1 < argc && strcmp(argv[arg], "-n") == 0) {
+    runs = atoi(argv[arg + 1]);
+    arg += 2;
+  }
+  if (arg >= argc || runs <= 0) {
+    std::cerr << "Usage: " << argv[0] << " [-n RUNS] SCRIPT...\n";
+    return 1;
+  }
+
+  // Fixed time so that the results do not depend on when the benchmark is run.
+  struct tm time = {};
+  time.tm_year = 2020 - 1900;
+  time.tm_mon = 4;
+  time.tm_mday = 23;
+  time.tm_wday = 6;
+  time.tm_hour = 6;
+
+  int status = 0;
+  for (; arg < argc; arg++) {
+    std::ifstream ifs(argv[arg]);
+    if (!ifs) {
+      std::cerr << "Cannot open: " << argv[arg] << "\n";
+      status = 1;
+      continue;
+    }
+    std::string code;
+    std::getline(ifs, code, '\0');
+    const Result result = measure(code, time, runs);
+    char buf[256];
+    snprintf(buf, sizeof(buf), "{\"script\": \"%s\", \"runs\": %d, \"wall_us\": %.1f, \"tokens\": %u, \"allocs\": %zu, \"alloc_bytes\": %zu, \"peak_heap\": %zu}", argv[arg], runs, result.wall_us, result.tokens, result.allocs, result.bytes, result.peak);
+    std::cout << buf << "\n";
+  }
+
+  return status;
+}
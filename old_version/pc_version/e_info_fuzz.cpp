@@ -0,0 +1,122 @@
+// Fuzz target for the script interpreter and its JSON parser.
+// Built with libFuzzer by clang, or as a standalone program which replays the given inputs and then runs random ones.
+// The standalone program saves a random input which crashes into e_info_fuzz_crash.dat.
+// Usage: e_info_fuzz_asan [-n ITERATIONS] [INPUT...]
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "../Script.h"
+#ifdef __SANITIZE_ADDRESS__
+#include <sanitizer/common_interface_defs.h>
+#endif
+
+namespace {
+
+// Operators and literals which random inputs are made of.
+const char *const words[] = {
+  "dup", "drop", "swap", "read", "write", "add", "sub", "mul", "div", "mod", "and", "or", "lt", "le", "gt", "ge", "eq", "ne",
+  "length", "concat", "substr", "find", "rfind", "replace", "format", "extract", "lookup", "print", "date", "battery", "wakeup",
+  "return", "?", ":", ";", "{", "}", "\"f\"", "f", "0", "1", "2", "-1", "100", "\"\"", "\"a\"", "\"\\u3042\\x41\\n\"",
+  "\"{\\\"a\\\": [1, \\\"b\\\", {\\\"c\\\": null}], \\\"d\\\": -1.5e3}\"", "\"[1, [2, [3]], \\\"x\\\"]\"", "\"a\"", "\"<p>x</p>\"",
+};
+
+void runScript(const uint8_t *data, size_t size) {
+  struct tm time = {};
+  Script script;
+  script.initialize(time, 3.14);
+  script.run(String(std::string((const char *)data, size)));
+}
+
+// Interprets the input as a JSON document followed by a key after the first NUL.
+void runJSON(const uint8_t *data, size_t size) {
+  const uint8_t *sep = (const uint8_t *)memchr(data, '\0', size);
+  const size_t len = sep ? sep - data : size;
+  std::string code = "\"";
+  for (size_t i = 0; i < len; i++) {
+    char buf[8];
+    snprintf(buf, sizeof(buf), "\\x%02x", data[i]);
+    code += buf;
+  }
+  code += "\"\t";
+  code += sep ? std::string((const char *)sep + 1, size - len - 1) : std::string("0");
+  code += "\tlookup\t0\tlookup\t\"a\"\tlookup\tlength\t0\t0\t0\tprint";
+  runScript((const uint8_t *)code.data(), code.length());
+}
+
+#ifndef FUZZING
+std::string last_input;  // Random input being run, saved only if it crashes.
+
+void saveLastInput() {
+  const int fd = open("e_info_fuzz_crash.dat", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return;
+  if (write(fd, last_input.data(), last_input.length()) < 0) {}
+  close(fd);
+}
+
+void onSignal(int sig) {
+  saveLastInput();
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+#endif
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if (size == 0) return 0;
+  if (data[0] & 0x01) runJSON(data + 1, size - 1); else runScript(data + 1, size - 1);
+  return 0;
+}
+
+#ifndef FUZZING
+int main(int argc, char *argv[]) {
+  int iterations = 10000;
+  int arg = 1;
+  if (arg + 1 < argc && strcmp(argv[arg], "-n") == 0) {
+    iterations = atoi(argv[arg + 1]);
+    arg += 2;
+  }
+
+  for (; arg < argc; arg++) {
+    std::ifstream ifs(argv[arg], std::ios::binary);
+    const std::string buf((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    std::cerr << "Input: " << argv[arg] << "\n";
+    LLVMFuzzerTestOneInput((const uint8_t *)buf.data(), buf.length());
+  }
+
+  // libFuzzer saves crashing inputs by itself, and the standalone program does the same for the random ones.
+#ifdef __SANITIZE_ADDRESS__
+  __sanitizer_set_death_callback(saveLastInput);
+#endif
+  signal(SIGSEGV, onSignal);
+  signal(SIGABRT, onSignal);
+  srand(1);
+  constexpr int words_size = sizeof(words) / sizeof(words[0]);
+  for (int i = 0; i < iterations; i++) {
+    std::string buf(1, (char)(rand() & 0x01));
+    const int length = rand() % 64;
+    for (int j = 0; j < length; j++) {
+      if (buf[0] & 0x01) {
+        buf += "{}[]\",:\\ 0a-.tu"[rand() % 16];
+      } else {
+        buf += words[rand() % words_size];
+        buf += '\t';
+      }
+    }
+    last_input = buf;
+    LLVMFuzzerTestOneInput((const uint8_t *)buf.data(), buf.length());
+  }
+  std::cerr << "Done: " << iterations << " iterations\n";
+
+  return 0;
+}
+#endif
@@ -0,0 +1,91 @@
+// Renders a script into the frames of the EPD on the host, by the same interpreter and renderer as the device.
+// Writes blk.pbm and red.pbm (P4, 1 = ink) into the output directory, and prints the sleep time in seconds.
+// Pages are read from the cache files in the current directory, and fetched with curl if -f is given.
+// Usage: e_info_render [-t "YYYY-MM-DD HH:MM"] [-b VOLTAGE] [-f] FONT SCRIPT [OUTDIR]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include "../Render.h"
+#include "../Script.h"
+
+namespace {
+
+bool readFile(const char *path, std::string *data) {
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs) return false;
+  data->assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());  // The font has null bytes.
+  return true;
+}
+
+bool writePBM(const std::string &path, const uint8_t *buf) {
+  std::ofstream ofs(path, std::ios::binary);
+  ofs << "P4\n" << Render::WIDTH << " " << Render::HEIGHT << "\n";
+  ofs.write((const char *)buf, Render::FRAME_SIZE);
+  return (bool)ofs;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  time_t now = ::time(nullptr);
+  struct tm time = *localtime(&now);
+  float battery = 3.14;
+  bool fetch = false;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    if (strcmp(argv[arg], "-f") == 0) {
+      fetch = true;
+    } else if (strcmp(argv[arg], "-b") == 0 && arg + 1 < argc) {
+      battery = atof(argv[++arg]);
+    } else if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+      time = {};
+      if (!strptime(argv[++arg], "%Y-%m-%d %H:%M", &time)) break;
+      time.tm_isdst = -1;
+      mktime(&time);  // Fills the day of the week.
+    } else {
+      break;
+    }
+  }
+  if (arg + 2 != argc && arg + 3 != argc) {
+    std::cerr << "Usage: " << argv[0] << " [-t \"YYYY-MM-DD HH:MM\"] [-b VOLTAGE] [-f] FONT SCRIPT [OUTDIR]\n";
+    return 1;
+  }
+  const std::string dir = (arg + 3 == argc) ? std::string(argv[arg + 2]) + "/" : "";
+
+  std::string font;
+  if (!readFile(argv[arg], &font) || font.size() != Render::FONT_SIZE) {
+    std::cerr << "Invalid font: " << argv[arg] << "\n";
+    return 1;
+  }
+  std::string code;
+  if (!readFile(argv[arg + 1], &code)) {
+    std::cerr << "Cannot open: " << argv[arg + 1] << "\n";
+    return 1;
+  }
+
+  Script script;
+  if (fetch) script.enableFetch();
+  script.initialize(time, battery);
+  script.run(String(code));
+  const uint8_t *text;
+  const uint8_t *attr;
+  script.getScreen(&text, &attr);
+
+  static uint16_t glyphs[Render::FONT_SIZE / 2];
+  for (int i = 0; i < Render::FONT_SIZE / 2; i++) glyphs[i] = (uint8_t)font[2 * i] | ((uint8_t)font[2 * i + 1] << 8);  // Little endian as in the preferences of the device.
+  static uint8_t buf_blk[Render::FRAME_SIZE];
+  static uint8_t buf_red[Render::FRAME_SIZE];
+  Render::draw(text, attr, glyphs, buf_blk, buf_red);
+  if (!writePBM(dir + "blk.pbm", buf_blk) || !writePBM(dir + "red.pbm", buf_red)) {
+    std::cerr << "Cannot write the frames into: " << dir << "\n";
+    return 1;
+  }
+  std::cout << script.getSleepTime() / 1000000 << "\n";
+  return 0;
+}
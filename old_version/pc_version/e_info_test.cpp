@@ -1,9 +1,113 @@
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <time.h>
+#include "../Render.h"
 #include "../Script.h"
 
-int main(void) {
+namespace {
+
+// drawScreen() of the firmware before Render was split from it, without reading the font from the preferences.
+void drawScreenBaseline(const uint8_t *text, const uint8_t *attr, const uint16_t *font, uint8_t *buf_blk, uint8_t *buf_red) {
+  uint16_t bmp_blk[Script::WIDTH];
+  uint16_t bmp_red[Script::WIDTH];
+
+  for (int ty = 0; ty < Script::HEIGHT; ty++) {
+    for (int h = 0; h < Script::PIXELS; h++) {
+      int tx = 0;
+      // Copy the font bitmap for one line.
+      for (int w = 0; w < Script::WIDTH; w++) {
+        const uint8_t a = attr[2 * Script::WIDTH * ty + tx];
+        const uint8_t c = text[2 * Script::WIDTH * ty + tx++];
+        uint16_t f;
+        if (a & 0x04) {
+          const uint8_t cc = 0xd0 + ((c - 0x20) >> 1);
+          const uint8_t d = text[2 * Script::WIDTH * ty + tx++];
+          const uint8_t dd = 0xd0 + ((d - 0x20) >> 1);
+          if (c & 0x01) {
+            f = (font[Script::PIXELS * cc + h] << 6);
+          } else {
+            f = (font[Script::PIXELS * cc + h] & 0xf800);;
+          }
+          if (d & 0x01) {
+            f |= (font[Script::PIXELS * dd + h] & 0x03e0);
+          } else {
+            f |= (font[Script::PIXELS * dd + h] >> 6);;
+          }
+        } else {
+          f = font[Script::PIXELS * c + h];
+        }
+        if (a & 0x02) {
+          f = ~f;
+        }
+        if (a & 0x01) {
+          bmp_blk[w] = 0x00;
+          bmp_red[w] = (f & 0xffe0);
+        } else {
+          bmp_blk[w] = (f & 0xffe0);
+          bmp_red[w] = 0x00;
+        }
+      }
+
+      // Render the font to the screen buffer.
+      int ptr = (Render::WIDTH / 8) * (Script::PIXELS * ty + h);
+      int size = 8;
+      uint8_t acc_blk = 0x00;
+      uint8_t acc_red = 0x00;
+      for (int w = 0; w < Script::WIDTH; w++) {
+        acc_blk |= (uint8_t)(bmp_blk[w] >> (16 - size));
+        acc_red |= (uint8_t)(bmp_red[w] >> (16 - size));
+        buf_blk[ptr] = acc_blk;
+        buf_red[ptr] = acc_red;
+        ptr++;
+        if (11 - size >= 8) {
+          buf_blk[ptr] = (uint8_t)((bmp_blk[w] >> (16 - size - 8)) & 0x00ff);
+          buf_red[ptr] = (uint8_t)((bmp_red[w] >> (16 - size - 8)) & 0x00ff);
+          ptr++;
+          size += 8;
+        }
+        acc_blk = (uint8_t)((bmp_blk[w] << size) >> 8);
+        acc_red = (uint8_t)((bmp_red[w] << size) >> 8);
+        size = 8 - (11 - size);
+      }
+    }
+  }
+}
+
+// Compares Render::draw() with the baseline on random screens and fonts. Returns the number of mismatches.
+int checkRender(int runs) {
+  static uint8_t text[2 * Script::WIDTH * Script::HEIGHT];
+  static uint8_t attr[2 * Script::WIDTH * Script::HEIGHT];
+  static uint16_t font[Render::FONT_SIZE / 2];
+  static uint8_t blk[2][Render::FRAME_SIZE];
+  static uint8_t red[2][Render::FRAME_SIZE];
+  int failures = 0;
+  srand(1);
+  for (int run = 0; run < runs; run++) {
+    for (int i = 0; i < (int)sizeof(text); i++) {
+      text[i] = rand();
+      attr[i] = rand() & 0x07;  // Red, inverted, and half width.
+    }
+    for (int i = 0; i < Render::FONT_SIZE / 2; i++) font[i] = rand();
+    memset(blk, 0x5a, sizeof(blk));
+    memset(red, 0xa5, sizeof(red));
+    Render::draw(text, attr, font, blk[0], red[0]);
+    drawScreenBaseline(text, attr, font, blk[1], red[1]);
+    if (memcmp(blk[0], blk[1], Render::FRAME_SIZE) != 0 || memcmp(red[0], red[1], Render::FRAME_SIZE) != 0) {
+      std::cout << "Render mismatch: " << run << "\n";
+      failures++;
+    }
+  }
+  std::cout << "Render checked: " << runs << " screens, " << failures << " mismatches\n";
+  return failures;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1 && strcmp(argv[1], "-r") == 0) return (checkRender(100) ? 1 : 0);
+  const bool profiling = (argc > 1 && strcmp(argv[1], "-p") == 0);
   time_t timer;
   time(&timer);
   const struct tm *time = localtime(&timer);
@@ -13,7 +117,9 @@ int main(void) {
 
   Script script;
   script.initialize(*time, 3.14);
+  if (profiling) script.enableProfiler();
   script.run(buf);
+  if (profiling) std::cerr << "----- Profile -----\n" << script.getProfile().string();
 
   std::cout << "Sleep time: " << script.getSleepTime() << "\n";
   const uint8_t *text, *attr;
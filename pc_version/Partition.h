@@ -0,0 +1,82 @@
+// ESP-IDF partition API on a flash image in memory.
+
+#ifndef PARTITION_H_
+#define PARTITION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+typedef int esp_err_t;
+constexpr esp_err_t ESP_OK = 0;
+constexpr esp_err_t ESP_ERR_INVALID_ARG = 0x102;
+
+typedef enum {
+  ESP_PARTITION_TYPE_APP = 0x00,
+  ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum {
+  ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+typedef struct {
+  esp_partition_type_t type;
+  esp_partition_subtype_t subtype;
+  uint32_t address;
+  uint32_t size;
+  char label[17];
+  bool encrypted;
+} esp_partition_t;
+
+// The "frames" partition in partitions.csv. Writes only clear bits as NOR flash does, and erases count per sector.
+struct Partition {
+  static constexpr const uint32_t SIZE = 0x200000;
+  static constexpr const uint32_t SECTOR_SIZE = 4096;
+
+  static esp_partition_t &info() {
+    static esp_partition_t info = {ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, 0x200000, SIZE, "frames", false};
+    return info;
+  }
+
+  static uint8_t *data() {
+    static uint8_t data[SIZE];
+    return data;
+  }
+
+  static uint32_t *erases() {
+    static uint32_t erases[SIZE / SECTOR_SIZE];
+    return erases;
+  }
+
+  // Fills the flash with zeros, which is not a valid index, and clears the erase counts.
+  static void reset() {
+    memset(data(), 0, SIZE);
+    memset(erases(), 0, sizeof(uint32_t) * (SIZE / SECTOR_SIZE));
+  }
+};
+
+inline const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label) {
+  return (type == Partition::info().type && strcmp(label, Partition::info().label) == 0) ? &Partition::info() : nullptr;
+}
+
+inline esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *dst, size_t size) {
+  if (offset + size > partition->size) return ESP_ERR_INVALID_ARG;
+  memcpy(dst, Partition::data() + offset, size);
+  return ESP_OK;
+}
+
+inline esp_err_t esp_partition_write(const esp_partition_t *partition, size_t offset, const void *src, size_t size) {
+  if (offset + size > partition->size) return ESP_ERR_INVALID_ARG;
+  for (size_t i = 0; i < size; i++) Partition::data()[offset + i] &= ((const uint8_t *)src)[i];
+  return ESP_OK;
+}
+
+inline esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+  if (offset % Partition::SECTOR_SIZE || size % Partition::SECTOR_SIZE || offset + size > partition->size) return ESP_ERR_INVALID_ARG;
+  memset(Partition::data() + offset, 0xff, size);
+  for (size_t sector = offset; sector < offset + size; sector += Partition::SECTOR_SIZE) Partition::erases()[sector / Partition::SECTOR_SIZE]++;
+  return ESP_OK;
+}
+
+#endif
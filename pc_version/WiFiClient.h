@@ -0,0 +1,106 @@
+// Arduino WiFiClient on POSIX sockets, with the few Arduino functions which TLSClient uses.
+
+#ifndef WIFICLIENT_H_
+#define WIFICLIENT_H_
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define RTC_DATA_ATTR
+
+inline uint32_t millis() {
+  static const auto start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline void delay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+class IPAddress {
+public:
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : str_(std::to_string(a) + "." + std::to_string(b) + "." + std::to_string(c) + "." + std::to_string(d)) {
+  }
+
+  std::string toString() const {
+    return str_;
+  }
+
+private:
+  std::string str_;
+};
+
+// Reads and writes do not block, as on the device.
+class WiFiClient {
+public:
+  WiFiClient() : fd_(-1) {
+  }
+
+  ~WiFiClient() {
+    stop();
+  }
+
+  int connect(const char *host, uint16_t port, int32_t timeout) {
+    stop();
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *res;
+    if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &res) != 0) return 0;
+    for (addrinfo *ai = res; ai && fd_ < 0; ai = ai->ai_next) {
+      fd_ = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd_ < 0) continue;
+      fcntl(fd_, F_SETFL, O_NONBLOCK);
+      pollfd pfd = {fd_, POLLOUT, 0};
+      int err = 0;
+      socklen_t len = sizeof(err);
+      if (::connect(fd_, ai->ai_addr, ai->ai_addrlen) != 0 && (errno != EINPROGRESS || poll(&pfd, 1, timeout) != 1 || getsockopt(fd_, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0)) stop();
+    }
+    freeaddrinfo(res);
+    return (fd_ >= 0) ? 1 : 0;
+  }
+
+  size_t write(const uint8_t *buf, size_t size) {
+    if (fd_ < 0) return 0;
+    const ssize_t n = send(fd_, buf, size, MSG_NOSIGNAL);
+    return (n > 0) ? n : 0;
+  }
+
+  int available() {
+    int n = 0;
+    return (fd_ >= 0 && ioctl(fd_, FIONREAD, &n) == 0) ? n : 0;
+  }
+
+  int read(uint8_t *buf, size_t size) {
+    if (fd_ < 0) return -1;
+    const ssize_t n = recv(fd_, buf, size, 0);
+    return (n > 0) ? n : -1;
+  }
+
+  uint8_t connected() {
+    if (fd_ < 0) return 0;
+    uint8_t c;
+    const ssize_t n = recv(fd_, &c, 1, MSG_PEEK);
+    return (n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)));
+  }
+
+  void stop() {
+    if (fd_ >= 0) close(fd_);
+    fd_ = -1;
+  }
+
+private:
+  int fd_;
+};
+
+#endif
@@ -0,0 +1,147 @@
+// Test of the frame queue on a flash image in memory.
+// Checks that an update which is not committed leaves the stored queue intact, that a long update drops the oldest stored frames
+// as it wraps around onto them, that the queue never touches the retained copy, and that the retained copy rotates evenly
+// and survives a cut off write. Prints the failed checks.
+// Usage: frame_queue_test
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "../FrameQueue.h"
+
+namespace {
+
+constexpr int PLANE_SIZE = 176 / 8 * 264;  // Same as the firmware.
+constexpr int BAND_SIZE = 176 / 8 * 40;  // Planes are written in bands of rows.
+constexpr uint32_t PLANE_AREA = (PLANE_SIZE + FrameQueue::SECTOR_SIZE - 1) / FrameQueue::SECTOR_SIZE * FrameQueue::SECTOR_SIZE;
+
+int failures = 0;
+
+void check(bool ok, const std::string &what) {
+  if (ok) return;
+  std::cout << "NG: " << what << "\n";
+  failures++;
+}
+
+// Fills the plane with a pattern given by the tag.
+void pattern(int tag, int plane, uint8_t *buf) {
+  for (int i = 0; i < PLANE_SIZE; i++) buf[i] = i * 7 + tag * 3 + plane;
+}
+
+bool put(FrameQueue &queue, int slot, int tag) {
+  static uint8_t buf[PLANE_SIZE];
+  for (int plane = 0; plane < 2; plane++) {
+    pattern(tag, plane, buf);
+    for (int ofst = 0; ofst < PLANE_SIZE; ofst += BAND_SIZE) {
+      if (!queue.write(slot, plane, ofst, buf + ofst, std::min(BAND_SIZE, PLANE_SIZE - ofst))) return false;
+    }
+  }
+  return true;
+}
+
+bool has(const FrameQueue &queue, int slot, int tag) {
+  static uint8_t expected[PLANE_SIZE];
+  static uint8_t buf[PLANE_SIZE];
+  for (int plane = 0; plane < 2; plane++) {
+    pattern(tag, plane, expected);
+    if (!queue.read(slot, plane, 0, buf, PLANE_SIZE) || memcmp(buf, expected, PLANE_SIZE) != 0) return false;
+  }
+  return true;
+}
+
+// Returns the stored queue as the next wake loads it.
+FrameQueue reload() {
+  FrameQueue queue(PLANE_SIZE);
+  check(queue.begin(), "begin");
+  return queue;
+}
+
+// Returns the total erase count of the sectors of the copy of RETAINED, or of all the copies if copy < 0.
+uint32_t retained_erases(int capacity, int copy) {
+  const uint32_t bgn = FrameQueue::SECTOR_SIZE + 2 * (capacity + std::max(copy, 0)) * PLANE_AREA;
+  const uint32_t end = (copy < 0) ? Partition::SIZE : bgn + 2 * PLANE_AREA;
+  uint32_t sum = 0;
+  for (uint32_t sector = bgn / Partition::SECTOR_SIZE; sector < end / Partition::SECTOR_SIZE; sector++) sum += Partition::erases()[sector];
+  return sum;
+}
+
+}
+
+int main() {
+  Partition::reset();
+  FrameQueue queue = reload();
+  check(queue.size() == 0, "empty partition");
+  const int capacity = queue.capacity();
+  std::cout << "Capacity: " << capacity << "\n";
+  uint32_t times[FrameQueue::CAPACITY];
+
+  // First queue of 3 frames.
+  for (int i = 0; i < 3; i++) {
+    check(put(queue, i, 10 + i), "write first queue");
+    times[i] = 100 + i;
+  }
+  check(queue.commit(times, 3, 1000), "commit first queue");
+  queue = reload();
+  check(queue.size() == 3 && queue.expires() == 1000 && queue.time(2) == 102, "index of first queue");
+  for (int i = 0; i < 3; i++) check(has(queue, i, 10 + i), "frame " + std::to_string(i) + " of first queue");
+
+  // The retained copy.
+  check(put(queue, FrameQueue::RETAINED, 55) && queue.retain(), "write retained");
+  const uint32_t erases = retained_erases(capacity, -1);
+
+  // An update cut off before commit() leaves the stored queue intact.
+  check(put(queue, 0, 90) && put(queue, 1, 91), "write cut off queue");
+  queue = reload();
+  check(queue.size() == 3 && queue.time(0) == 100, "index after cut off queue");
+  for (int i = 0; i < 3; i++) check(has(queue, i, 10 + i), "frame " + std::to_string(i) + " after cut off queue");
+
+  // A full update wraps around onto the stored queue, whose oldest frames are dropped one by one.
+  for (int i = 0; i < capacity; i++) {
+    check(put(queue, i, 20 + i), "write full queue " + std::to_string(i));
+    times[i] = 200 + i;
+    const int kept = std::min(3, capacity - 1 - i);
+    FrameQueue stored = reload();
+    check(stored.size() == kept, "stored size while writing " + std::to_string(i));
+    for (int j = 0; j < kept; j++) check(stored.time(j) == (uint32_t)(103 - kept + j) && has(stored, j, 13 - kept + j), "stored frame " + std::to_string(j) + " while writing " + std::to_string(i));
+  }
+  check(queue.commit(times, capacity, 2000), "commit full queue");
+  queue = reload();
+  check(queue.size() == capacity && queue.expires() == 2000, "index of full queue");
+  for (int i = 0; i < capacity; i++) check(has(queue, i, 20 + i), "frame " + std::to_string(i) + " of full queue");
+
+  // The next update starts by dropping the oldest frame of the full queue.
+  check(put(queue, 0, 7), "write after full queue");
+  check(reload().size() == capacity - 1, "drop from full queue");
+  times[0] = 5000;
+  check(queue.commit(times, 1, 6000), "commit after full queue");
+  queue = reload();
+  check(queue.size() == 1 && has(queue, 0, 7), "queue after full queue");
+
+  check(retained_erases(capacity, -1) == erases && has(queue, FrameQueue::RETAINED, 55), "retained copy untouched by the queue");
+
+  // A retained copy cut off before retain() leaves the current one intact.
+  check(put(queue, FrameQueue::RETAINED, 56), "write cut off retained");
+  check(has(reload(), FrameQueue::RETAINED, 55), "retained after cut off copy");
+
+  // Frequent changes rotate through the copies, and the index is erased only when its bits run out.
+  const uint32_t index_erases = Partition::erases()[0];
+  constexpr int CHANGES = 100 * FrameQueue::COPIES;
+  for (int i = 0; i < CHANGES; i++) {
+    check(put(queue, FrameQueue::RETAINED, 60 + i) && queue.retain(), "write retained " + std::to_string(i));
+    if (i % 7 == 0) check(has(reload(), FrameQueue::RETAINED, 60 + i), "reload retained " + std::to_string(i));
+  }
+  check(has(reload(), FrameQueue::RETAINED, 60 + CHANGES - 1) && reload().size() == 1 && has(reload(), 0, 7), "queue after rotating retained");
+  check(Partition::erases()[0] - index_erases <= CHANGES / 32 + 1, "index erases while rotating retained");
+  for (int copy = 0; copy < FrameQueue::COPIES; copy++) {
+    const uint32_t n = retained_erases(capacity, copy);
+    check(n >= 2 * 2 * CHANGES / FrameQueue::COPIES && n <= 2 * 2 * (CHANGES / FrameQueue::COPIES + 2), "erases of retained copy " + std::to_string(copy) + ": " + std::to_string(n));
+  }
+
+  // An index of another geometry is not used.
+  FrameQueue other(PLANE_SIZE + 8);
+  check(other.begin() && other.size() == 0, "other geometry");
+
+  std::cout << (failures ? "Failed: " + std::to_string(failures) : std::string("OK")) << "\n";
+  return (failures ? 1 : 0);
+}
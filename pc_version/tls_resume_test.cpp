@@ -0,0 +1,57 @@
+// Test of TLS session resumption of TLSClient with the desktop mbedtls against daemon/tls_test_server.py.
+// Connects to the server twice with new clients, as two wakes do. The second one must resume the session restored from the cache
+// in RTC memory, that is, finish the handshake without the certificate of the server. Prints the handshake times.
+// Usage: tls_resume_test [-p PORT]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "../TLSClient.h"
+
+namespace {
+
+// Fetches the headers of the top page through a new client, and tells whether the handshake was resumed. Returns false on failure.
+bool request(uint16_t port, bool *resumed) {
+  TLSClient tls;
+  if (!tls.connect("localhost", port)) return false;
+  const char req[] = "HEAD / HTTP/1.0\r\nHost: localhost\r\n\r\n";
+  if (tls.write((const uint8_t *)req, strlen(req)) != strlen(req)) return false;
+  std::string res;
+  const uint32_t bgn = millis();
+  while (res.find("\r\n") == std::string::npos && millis() - bgn < 5000) {
+    uint8_t buf[256];
+    const int n = tls.read(buf, sizeof(buf));
+    if (n > 0) res.append((const char *)buf, n); else delay(1);
+  }
+  *resumed = tls.resumed();
+  std::cout << "Handshake: " << tls.handshakeTime() << " ms, session " << (tls.resumed() ? "resumed" : "full") << ", response: " << res.substr(0, res.find("\r\n")) << "\n";
+  return (res.compare(0, 5, "HTTP/") == 0);
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  uint16_t port = 8443;
+  if (argc == 3 && strcmp(argv[1], "-p") == 0) {
+    port = atoi(argv[2]);
+  } else if (argc != 1) {
+    std::cerr << "Usage: " << argv[0] << " [-p PORT]\n";
+    return 1;
+  }
+  if (!TLSCLIENT_SESSION_CACHE) {
+    std::cout << "mbedtls " << MBEDTLS_VERSION_STRING << " cannot save sessions.\n";
+    return 1;
+  }
+
+  bool first = false;
+  bool second = false;
+  if (!request(port, &first) || !request(port, &second)) {
+    std::cout << "Failed to connect to the server on port " << port << ".\n";
+    return 1;
+  }
+  const bool ok = (!first && second);
+  std::cout << (ok ? "OK" : "Failed: the second handshake was not abbreviated") << "\n";
+  return (ok ? 0 : 1);
+}
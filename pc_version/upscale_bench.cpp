@@ -0,0 +1,100 @@
+// Benchmark for the upscaler of half resolution frames.
+// Checks the table-driven kernel against a per-pixel reference on random planes, on whole planes and band by band as in streaming,
+// and prints one JSON object per mode.
+// Usage: upscale_bench [-n RUNS]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "../Upscale.h"
+
+namespace {
+
+constexpr int WIDTH = 176;
+constexpr int HEIGHT = 264;
+constexpr int LINE_SIZE = WIDTH / 8;
+constexpr int PLANE_SIZE = LINE_SIZE * HEIGHT;
+constexpr int BAND_HEIGHTS[] = {8, 50};  // 50 leaves a short last band.
+
+// Reference which copies each pixel from the source plane.
+void reference(const uint8_t *src, uint8_t *dst, bool half_width, bool half_height) {
+  const int src_line = half_width ? LINE_SIZE / 2 : LINE_SIZE;
+  memset(dst, 0, PLANE_SIZE);
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      const int sx = half_width ? x / 2 : x;
+      const int sy = half_height ? y / 2 : y;
+      if (src[src_line * sy + sx / 8] & (0x80 >> (sx % 8))) dst[LINE_SIZE * y + x / 8] |= (0x80 >> (x % 8));
+    }
+  }
+}
+
+// Expands the plane in bands of band_height rows as the firmware does in streaming, and compares the concatenated bands with expected.
+bool checkBands(const uint8_t *src, const uint8_t *expected, int band_height, bool half_width, bool half_height) {
+  static uint8_t band[PLANE_SIZE];
+  const int src_line = half_width ? LINE_SIZE / 2 : LINE_SIZE;
+  const int step = half_height ? 2 : 1;
+  for (int row = 0; row < HEIGHT; row += band_height) {
+    const int rows = (row + band_height < HEIGHT) ? band_height : HEIGHT - row;
+    memcpy(band, src + src_line * (row / step), src_line * (rows / step));
+    Upscale::expand(band, LINE_SIZE, rows, half_width, half_height);
+    if (memcmp(band, expected + LINE_SIZE * row, LINE_SIZE * rows) != 0) return false;
+  }
+  return true;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  int runs = 1000;
+  if (argc == 3 && strcmp(argv[1], "-n") == 0) {
+    runs = atoi(argv[2]);
+  } else if (argc != 1) {
+    runs = 0;
+  }
+  if (runs <= 0) {
+    std::cerr << "Usage: " << argv[0] << " [-n RUNS]\n";
+    return 1;
+  }
+
+  static uint8_t src[PLANE_SIZE];
+  static uint8_t buf[PLANE_SIZE];
+  static uint8_t expected[PLANE_SIZE];
+  srand(1);
+  for (int i = 0; i < PLANE_SIZE; i++) src[i] = rand();
+
+  int status = 0;
+  for (int mode = 1; mode < 4; mode++) {
+    const bool half_width = (mode & 1);
+    const bool half_height = (mode & 2);
+    const int size = PLANE_SIZE / (half_width ? 2 : 1) / (half_height ? 2 : 1);
+    reference(src, expected, half_width, half_height);
+    memcpy(buf, src, size);
+    Upscale::expand(buf, LINE_SIZE, HEIGHT, half_width, half_height);
+    bool match = (memcmp(buf, expected, PLANE_SIZE) == 0);
+    for (const int band_height : BAND_HEIGHTS) {
+      if (!checkBands(src, expected, band_height, half_width, half_height)) match = false;
+    }
+    if (!match) status = 1;
+
+    double kernel_us = 0.0;
+    double reference_us = 0.0;
+    for (int i = 0; i < runs; i++) {
+      memcpy(buf, src, size);
+      const auto bgn = std::chrono::steady_clock::now();
+      Upscale::expand(buf, LINE_SIZE, HEIGHT, half_width, half_height);
+      const auto mid = std::chrono::steady_clock::now();
+      reference(src, expected, half_width, half_height);
+      const auto end = std::chrono::steady_clock::now();
+      kernel_us += std::chrono::duration<double, std::micro>(mid - bgn).count() / runs;
+      reference_us += std::chrono::duration<double, std::micro>(end - mid).count() / runs;
+    }
+    char line[256];
+    snprintf(line, sizeof(line), "{\"half_width\": %s, \"half_height\": %s, \"runs\": %d, \"data_bytes\": %d, \"plane_bytes\": %d, \"kernel_us\": %.2f, \"reference_us\": %.2f, \"match\": %s}", half_width ? "true" : "false", half_height ? "true" : "false", runs, size, PLANE_SIZE, kernel_us, reference_us, match ? "true" : "false");
+    std::cout << line << "\n";
+  }
+
+  return status;
+}